@@ -0,0 +1,190 @@
+#include "Aggregation.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AGGREGATION_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Struct to hold the partial SUM, MIN and MAX of a batch of values.
+ */
+struct BatchAggregate {
+    double sum;
+    double min;
+    double max;
+};
+
+typedef BatchAggregate (*ReduceKernel)(const double* values, unsigned int numValues);
+
+// Reduction kernels
+// Each kernel reduces a non-empty batch of values to its sum, minimum and maximum
+/**
+ * @brief Reduces a batch of values one value at a time.
+ * @param values The values to reduce.
+ * @param numValues The number of values in the batch, at least 1.
+ * @return The sum, minimum and maximum of the batch.
+ */
+static BatchAggregate reduceScalar(const double* values, unsigned int numValues) {
+    BatchAggregate batch = {0, values[0], values[0]};
+    for (unsigned int i = 0; i < numValues; i++) {
+        batch.sum += values[i];
+        batch.min = values[i] < batch.min ? values[i] : batch.min;
+        batch.max = values[i] > batch.max ? values[i] : batch.max;
+    }
+    return batch;
+}
+
+#ifdef AGGREGATION_X86
+/**
+ * @brief Reduces a batch of values two values at a time using SSE2.
+ * @param values The values to reduce.
+ * @param numValues The number of values in the batch, at least 1.
+ * @return The sum, minimum and maximum of the batch.
+ */
+__attribute__((target("sse2")))
+static BatchAggregate reduceSse2(const double* values, unsigned int numValues) {
+    __m128d sum = _mm_setzero_pd();
+    __m128d min = _mm_set1_pd(values[0]);
+    __m128d max = min;
+    unsigned int i = 0;
+    for (; i + 2 <= numValues; i += 2) {
+        __m128d block = _mm_loadu_pd(values + i);
+        sum = _mm_add_pd(sum, block);
+        min = _mm_min_pd(min, block);
+        max = _mm_max_pd(max, block);
+    }
+
+    // Combine the lanes, then the values left over
+    double lanes[3][2];
+    _mm_storeu_pd(lanes[0], sum);
+    _mm_storeu_pd(lanes[1], min);
+    _mm_storeu_pd(lanes[2], max);
+    BatchAggregate batch = {lanes[0][0] + lanes[0][1],
+                            lanes[1][0] < lanes[1][1] ? lanes[1][0] : lanes[1][1],
+                            lanes[2][0] > lanes[2][1] ? lanes[2][0] : lanes[2][1]};
+    if (i < numValues) {
+        BatchAggregate rest = reduceScalar(values + i, numValues - i);
+        batch.sum += rest.sum;
+        batch.min = rest.min < batch.min ? rest.min : batch.min;
+        batch.max = rest.max > batch.max ? rest.max : batch.max;
+    }
+    return batch;
+}
+
+/**
+ * @brief Reduces a batch of values four values at a time using AVX2.
+ * @param values The values to reduce.
+ * @param numValues The number of values in the batch, at least 1.
+ * @return The sum, minimum and maximum of the batch.
+ */
+__attribute__((target("avx2")))
+static BatchAggregate reduceAvx2(const double* values, unsigned int numValues) {
+    __m256d sum = _mm256_setzero_pd();
+    __m256d min = _mm256_set1_pd(values[0]);
+    __m256d max = min;
+    unsigned int i = 0;
+    for (; i + 4 <= numValues; i += 4) {
+        __m256d block = _mm256_loadu_pd(values + i);
+        sum = _mm256_add_pd(sum, block);
+        min = _mm256_min_pd(min, block);
+        max = _mm256_max_pd(max, block);
+    }
+
+    // Combine the lanes, then the values left over
+    double lanes[3][4];
+    _mm256_storeu_pd(lanes[0], sum);
+    _mm256_storeu_pd(lanes[1], min);
+    _mm256_storeu_pd(lanes[2], max);
+    BatchAggregate batch = {0, lanes[1][0], lanes[2][0]};
+    for (int lane = 0; lane < 4; lane++) {
+        batch.sum += lanes[0][lane];
+        batch.min = lanes[1][lane] < batch.min ? lanes[1][lane] : batch.min;
+        batch.max = lanes[2][lane] > batch.max ? lanes[2][lane] : batch.max;
+    }
+    if (i < numValues) {
+        BatchAggregate rest = reduceScalar(values + i, numValues - i);
+        batch.sum += rest.sum;
+        batch.min = rest.min < batch.min ? rest.min : batch.min;
+        batch.max = rest.max > batch.max ? rest.max : batch.max;
+    }
+    return batch;
+}
+#endif
+
+/**
+ * @brief Struct to hold the reduction kernel selected for this CPU.
+ */
+struct ReduceKernelEntry {
+    ReduceKernel reduce;
+    const char* name;
+};
+
+// Picks the widest reduction kernel supported by the CPU the program is running on
+/**
+ * @brief Selects the reduction kernel based on CPU feature detection.
+ * @return The selected kernel.
+ */
+static ReduceKernelEntry selectKernel() {
+#ifdef AGGREGATION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {reduceAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {reduceSse2, "sse2"};
+    }
+#endif
+    return {reduceScalar, "scalar"};
+}
+
+static const ReduceKernelEntry kernel = selectKernel();
+
+/**
+ * @brief Adds a batch of values to a running aggregate.
+ * @param values The values to add.
+ * @param numValues The number of values in the batch.
+ * @param result The running aggregate to update.
+ */
+void Aggregation::accumulate(const double* values, unsigned int numValues, AggregateResult& result) {
+    if (numValues == 0) {
+        return;
+    }
+    BatchAggregate batch = kernel.reduce(values, numValues);
+    if (result.count == 0) {
+        result.min = batch.min;
+        result.max = batch.max;
+    } else {
+        result.min = batch.min < result.min ? batch.min : result.min;
+        result.max = batch.max > result.max ? batch.max : result.max;
+    }
+    result.sum += batch.sum;
+    result.count += numValues;
+}
+
+/**
+ * @brief Adds a partial aggregate to a running aggregate.
+ * @param partial The partial aggregate to add.
+ * @param result The running aggregate to update.
+ */
+void Aggregation::merge(const AggregateResult& partial, AggregateResult& result) {
+    if (partial.count == 0) {
+        return;
+    }
+    if (result.count == 0) {
+        result.min = partial.min;
+        result.max = partial.max;
+    } else {
+        result.min = partial.min < result.min ? partial.min : result.min;
+        result.max = partial.max > result.max ? partial.max : result.max;
+    }
+    result.sum += partial.sum;
+    result.count += partial.count;
+}
+
+/**
+ * @brief Gets the name of the reduction kernel selected for this CPU.
+ * @return The name of the kernel.
+ */
+const char* Aggregation::getKernelName() {
+    return kernel.name;
+}
@@ -0,0 +1,51 @@
+#ifndef PROJECT1_AGGREGATION_H
+#define PROJECT1_AGGREGATION_H
+
+/**
+ * @brief Struct to hold the running COUNT, SUM, MIN and MAX of the values of a column.
+ */
+struct AggregateResult {
+    unsigned long long count = 0;
+    double sum = 0;
+    double min = 0; // only meaningful when count > 0
+    double max = 0;
+
+    /**
+     * @brief Gets the average of the values aggregated.
+     * @return The average, or 0 if no value has been aggregated.
+     */
+    double avg() const { return count == 0 ? 0 : sum / count; }
+};
+
+/**
+ * @brief Aggregation provides the reduction kernels used to aggregate the values of a column.
+ *
+ * Values are gathered into batches by the caller and reduced a batch at a time. The kernel (AVX2, SSE2 or scalar)
+ * is selected once at startup based on the features supported by the CPU, in the same way as KeySearch.
+ */
+class Aggregation {
+    public:
+
+        /**
+         * @brief Adds a batch of values to a running aggregate.
+         * @param values The values to add.
+         * @param numValues The number of values in the batch.
+         * @param result The running aggregate to update.
+         */
+        static void accumulate(const double* values, unsigned int numValues, AggregateResult& result);
+
+        /**
+         * @brief Adds a partial aggregate, e.g. of another thread, to a running aggregate.
+         * @param partial The partial aggregate to add.
+         * @param result The running aggregate to update.
+         */
+        static void merge(const AggregateResult& partial, AggregateResult& result);
+
+        /**
+         * @brief Gets the name of the reduction kernel selected for this CPU.
+         * @return The name of the kernel ("avx2", "sse2" or "scalar").
+         */
+        static const char* getKernelName();
+};
+
+#endif //PROJECT1_AGGREGATION_H
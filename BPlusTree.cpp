@@ -1,31 +1,93 @@
 #include "BPlusTree.h"
+#include "KeySearch.h"
 #include <iomanip>
 #include <cmath>
 #include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <queue>
+#include <mutex>
+#include <thread>
+
+// Smallest number of keys a node must hold, as a split hands at least one key to each of the two halves
+static const unsigned int MIN_NODE_KEYS = 2;
+
+// Number of times an optimistic lookup restarts, or waits for a node being changed, before it falls back to latch coupling
+static const int MAX_OPTIMISTIC_RESTARTS = 64;
+
+// Number of leaves whose records are counted by estimateRange() before it falls back to estimating
+static const unsigned int ESTIMATE_LEAF_BUDGET = 8;
 
 /**
  * @brief Constructs a B+ tree with the specified node size.
  *
  * This constructor initializes a B+ tree with the given node size. It sets various
  * statistics to zero and computes the maximum number of keys that a node can hold
- * based on the node size.
+ * based on the node size, and where each field of a node is stored.
  *
- * @param nodeSize The size (in bytes) of a B+ tree node.
+ * @param blockSize The size (in bytes) of the disk blocks holding the nodes.
+ * @param disk The disk whose blocks hold the nodes.
+ * @param withAggregates Whether every node entry holds the COUNT and SUM of a payload column.
+ * @param layout The layout of the fields within a node.
  */
-BPlusTree::BPlusTree(unsigned int nodeSize) {
+BPlusTree::BPlusTree(unsigned int blockSize, DiskAllocation* disk, bool withAggregates, NodeLayout layout) {
+    nodeDisk = disk;
+    hasAggregates = withAggregates;
+    nodeLayout = layout;
     numNodes = 0;
     numOverflowNodes = 0;
+    numInternalNodes = 0;
     numIndexAccessed = 0;
     numOverflowNodesAccessed = 0;
     numNodesDeleted = 0;
     numOverflowNodesDeleted = 0;
     height = 0;
+    isConcurrent = false;
+    isOptimistic = false;
+    rootVersion = 0;
+    treeVersion = 0;
     void* pointers[maxKeys + 1];
 
     // maxKeys = (size of a block - size of node's header - right most pointer) / (size of ptr-key pairs)
-    sizeOfNode = nodeSize;
-    const int sizeOfKeyPtrPair = (sizeof(pointerBlockPair) + sizeof(unsigned int));
-    maxKeys = (nodeSize - sizeof(NodeHeader) - sizeof(pointerBlockPair)) / sizeOfKeyPtrPair;
+    // With aggregates, every pointer (including the right most one) also carries an EntryAggregate
+    const int sizeOfAggregate = hasAggregates ? sizeof(EntryAggregate) : 0;
+    const int sizeOfKeyPtrPair = (sizeof(pointerBlockPair) + sizeof(unsigned int)) + sizeOfAggregate;
+    if (nodeLayout == PACKED_NODES) {
+        sizeOfNode = blockSize;
+        if (sizeOfNode < sizeof(NodeHeader) + sizeof(pointerBlockPair) + sizeOfAggregate) {
+            throw runtime_error("The block size is too small to hold a B+ tree node.");
+        }
+        maxKeys = (sizeOfNode - sizeof(NodeHeader) - sizeof(pointerBlockPair) - sizeOfAggregate) / sizeOfKeyPtrPair;
+        pointersOffset = sizeof(NodeHeader);
+        keysOffset = pointersOffset + (maxKeys + 1)*sizeof(pointerBlockPair);
+    } else {
+        // A node starts at the first cache line boundary of its block, so up to CACHE_LINE_SIZE - gcd(blockSize, CACHE_LINE_SIZE)
+        // bytes are skipped at the start of a block, as the disk itself starts on a cache line boundary
+        unsigned int alignment = CACHE_LINE_SIZE;
+        while (blockSize % alignment != 0) {
+            alignment /= 2;
+        }
+        if (blockSize < CACHE_LINE_SIZE - alignment) {
+            throw runtime_error("The block size is too small to hold a B+ tree node.");
+        }
+        sizeOfNode = blockSize - (CACHE_LINE_SIZE - alignment);
+
+        // The keys searched during a descent share the first cache lines with the header, and the pointers start on the next cache line
+        keysOffset = (sizeof(NodeHeader) + sizeof(float) - 1) / sizeof(float) * sizeof(float);
+        auto getPointersOffset = [&](unsigned int numKeys) {
+            return (keysOffset + numKeys*sizeof(float) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+        };
+        maxKeys = 0;
+        while (getPointersOffset(maxKeys + 1) + (maxKeys + 2)*(sizeof(pointerBlockPair) + sizeOfAggregate) <= sizeOfNode) {
+            maxKeys++;
+        }
+        pointersOffset = getPointersOffset(maxKeys);
+    }
+    if (maxKeys < MIN_NODE_KEYS) {
+        throw runtime_error("The block size is too small to hold a B+ tree node.");
+    }
+    aggregatesOffset = max(keysOffset + maxKeys*(unsigned int) sizeof(float), pointersOffset + (maxKeys + 1)*(unsigned int) sizeof(pointerBlockPair));
     root = getNewNode(true, false);
 }
 
@@ -40,7 +102,11 @@ BPlusTree::BPlusTree(unsigned int nodeSize) {
 * @return A pointer to the newly created node.
 */
 void* BPlusTree::getNewNode(bool isLeaf, bool isOverflow) {
-    void* addr = malloc(sizeOfNode);
+    void* blockAddr = nodeDisk->getNodeBlock();
+    if (blockAddr == nullptr) {
+        throw runtime_error("No unused blocks left on the disk for B+ tree nodes.");
+    }
+    void* addr = (char*) blockAddr + getNodeOffset(blockAddr);
 
     // Initialise header of the node
     NodeHeader* header;
@@ -50,22 +116,481 @@ void* BPlusTree::getNewNode(bool isLeaf, bool isOverflow) {
 
     // Initialise the pointer to parent
     pointerBlockPair ptr;
-    ptr.blockAddress = nullptr;
+    ptr.blockId = -1;
     ptr.recordID = -1;
     header->pointerToParent = ptr;
 
     // Initialise last pointer to null
     // Required for leaf nodes in case it is the last leaf node
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) addr ) + 1 );
-    float* pointsHomeArr = (float*) (ptrArr + maxKeys + 1);
-    ptrArr[maxKeys] = {nullptr, -1};
+    pointerBlockPair* ptrArr = getPointers(addr);
+    ptrArr[maxKeys] = {-1, -1};
+    if (hasAggregates) {
+        memset(getAggregates(addr), 0, (maxKeys + 1)*sizeof(EntryAggregate));
+    }
 
     // Incrementing number of nodes created for the B+ Tree
     isOverflow ? numOverflowNodes++ : numNodes++;
+    if (!isLeaf) {
+        numInternalNodes++;
+    }
 
     return addr;
 }
 
+// Releases a node that has been removed from the B+ Tree
+// The node's block is returned to the node pool of the disk, where it is reused for the next node created
+/**
+ * @brief Releases the disk block of a node that is no longer used.
+ * @param node The node to release.
+ */
+void BPlusTree::freeNode(void* node) {
+    if (!((NodeHeader*) node)->isLeaf) {
+        numInternalNodes--;
+    }
+    nodeDisk->releaseNodeBlock(node);
+}
+
+// Nodes refer to each other by the IDs of the blocks holding them, which are resolved with offset arithmetic on the disk
+/**
+ * @brief Resolves a reference to a node into the address of the node.
+ * @param pointer The reference, holding the ID of the block of the node.
+ * @return The address of the node, or nullptr if the reference leads nowhere.
+ */
+void* BPlusTree::getNode(const pointerBlockPair& pointer) {
+    if (pointer.blockId == -1) {
+        return nullptr;
+    }
+    void* blockAddr = nodeDisk->fetchBlockAddress(pointer.blockId);
+    return (char*) blockAddr + getNodeOffset(blockAddr);
+}
+
+// With ALIGNED_NODES, the bytes before the first cache line boundary of a block are skipped
+/**
+ * @brief Gets the offset of a node from the start of its block.
+ * @param blockAddr The address of the block.
+ * @return The offset of the node, in bytes.
+ */
+unsigned int BPlusTree::getNodeOffset(void* blockAddr) {
+    if (nodeLayout == PACKED_NODES) {
+        return 0;
+    }
+    return (CACHE_LINE_SIZE - (uintptr_t) blockAddr % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+}
+
+/**
+ * @brief Gets the ID of the block holding a node, to be stored in a reference to the node.
+ * @param node The address of the node, or nullptr.
+ * @return The ID of the block of the node, or -1 for nullptr.
+ */
+int BPlusTree::getNodeId(void* node) {
+    return (node == nullptr) ? -1 : nodeDisk->fetchBlockId(node);
+}
+
+// Swaps the empty root created by the constructor for the root of a tree that is already stored on the disk
+/**
+ * @brief Replaces the empty tree with an existing tree whose nodes are already stored on the disk.
+ * @param existingRoot The root node of the existing tree.
+ * @param existingHeight The height of the existing tree.
+ * @param existingNumNodes The number of nodes in the existing tree.
+ * @param existingNumOverflowNodes The number of overflow nodes in the existing tree.
+ */
+void BPlusTree::openExisting(void* existingRoot, unsigned int existingHeight, unsigned int existingNumNodes, unsigned int existingNumOverflowNodes) {
+    freeNode(root);
+    root = existingRoot;
+    height = existingHeight;
+    numNodes = existingNumNodes;
+    numOverflowNodes = existingNumOverflowNodes;
+    numInternalNodes = countInternalNodes(root);
+}
+
+// Visits the tree level by level, following the overflow chain of every duplicated key of a leaf
+/**
+ * @brief Lists every node of the tree in breadth-first order from the root.
+ * @param nodes Filled with the nodes of the tree.
+ * @param nodeKinds Filled with the NodeKind of each node.
+ */
+void BPlusTree::collectNodes(vector<void*>& nodes, vector<NodeKind>& nodeKinds) {
+    nodes.clear();
+    nodeKinds.clear();
+    queue<void*> nodesToVisit;
+    nodesToVisit.push(root);
+
+    while (!nodesToVisit.empty()) {
+        void* currNode = nodesToVisit.front();
+        nodesToVisit.pop();
+        NodeHeader* header = (NodeHeader*) currNode;
+        pointerBlockPair* ptrArr = getPointers(header);
+        nodes.push_back(currNode);
+        nodeKinds.push_back(header->isLeaf ? LEAF_NODE : NON_LEAF_NODE);
+
+        if (!header->isLeaf) {
+            for (unsigned int i = 0; i <= header->numKeys; i++) {
+                nodesToVisit.push(getNode(ptrArr[i]));
+            }
+            continue;
+        }
+        for (unsigned int i = 0; i < header->numKeys; i++) {
+            if (ptrArr[i].recordID != -1) {
+                continue;
+            }
+            void* overflowNode = getNode(ptrArr[i]);
+            while (overflowNode != nullptr) {
+                nodes.push_back(overflowNode);
+                nodeKinds.push_back(OVERFLOW_NODE);
+                overflowNode = getNode((getPointers(overflowNode))[maxKeys]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Works out what a pointer of a node leads to.
+ * @param header The header of the node.
+ * @param ptrArr The pointers of the node.
+ * @param kind The kind of the node.
+ * @param maxKeys The maximum number of keys of a node.
+ * @param i The index of the pointer, up to maxKeys.
+ * @param pointsToNode Set to true if the pointer leads to a node rather than a record.
+ * @return True if the pointer is in use.
+ */
+static bool getPointerTarget(NodeHeader* header, pointerBlockPair* ptrArr, NodeKind kind, unsigned int maxKeys, unsigned int i, bool& pointsToNode) {
+    pointsToNode = true;
+    if (kind == NON_LEAF_NODE) {
+        return i <= header->numKeys;
+    }
+    if (i == maxKeys) { // next leaf or overflow node
+        return true;
+    }
+    pointsToNode = (kind == LEAF_NODE && ptrArr[i].recordID == -1);
+    return i < header->numKeys;
+}
+
+// Renumbers the references of a copy of a node from block IDs into node indexes
+/**
+ * @brief Copies a node with its references to other nodes renumbered into node indexes.
+ * @param node The node to copy.
+ * @param kind The kind of the node.
+ * @param nodeIndexes The index of every node of the tree, by the ID of its block.
+ * @param image The buffer of sizeOfNode bytes to copy the node into.
+ */
+void BPlusTree::saveNodeImage(void* node, NodeKind kind, const unordered_map<int, unsigned int>& nodeIndexes, void* image) {
+    memcpy(image, node, sizeOfNode);
+    NodeHeader* header = (NodeHeader*) image;
+    pointerBlockPair* ptrArr = getPointers(header);
+
+    auto renumber = [&](pointerBlockPair& pointer, bool pointsToNode, bool isUsed) {
+        if (!isUsed || pointer.blockId == -1) {
+            pointer.blockId = -1;
+        } else if (pointsToNode) {
+            auto entry = nodeIndexes.find(pointer.blockId);
+            if (entry == nodeIndexes.end()) {
+                throw runtime_error("A B+ tree node points to a node that is not part of the tree.");
+            }
+            pointer.blockId = entry->second;
+        }
+    };
+
+    renumber(header->pointerToParent, true, kind != OVERFLOW_NODE);
+    for (unsigned int i = 0; i <= maxKeys; i++) {
+        bool pointsToNode;
+        bool isUsed = getPointerTarget(header, ptrArr, kind, maxKeys, i, pointsToNode);
+        renumber(ptrArr[i], pointsToNode, isUsed);
+    }
+}
+
+// Renumbers the references of a node copied with saveNodeImage() into the blocks the nodes and records were loaded into
+/**
+ * @brief Turns the node indexes and data block IDs of a node copied with saveNodeImage() into the IDs of the blocks now holding them, in place.
+ * @param node The node to update.
+ * @param kind The kind of the node.
+ * @param nodeBlockIds The ID of the block holding each node, by node index.
+ * @param dataBlockIds The ID of the block now holding each data block, by the block ID stored in the node.
+ */
+void BPlusTree::loadNodeImage(void* node, NodeKind kind, const vector<int>& nodeBlockIds, const unordered_map<int, int>& dataBlockIds) {
+    NodeHeader* header = (NodeHeader*) node;
+    pointerBlockPair* ptrArr = getPointers(header);
+
+    auto renumber = [&](pointerBlockPair& pointer, bool pointsToNode) {
+        if (pointer.blockId == -1) {
+            return;
+        }
+        if (pointsToNode) {
+            if (pointer.blockId < 0 || (size_t)pointer.blockId >= nodeBlockIds.size()) {
+                throw runtime_error("A B+ tree node points to a node that is not part of the snapshot.");
+            }
+            pointer.blockId = nodeBlockIds[pointer.blockId];
+        } else {
+            auto entry = dataBlockIds.find(pointer.blockId);
+            if (entry == dataBlockIds.end()) {
+                throw runtime_error("A B+ tree node points to a data block that is not part of the snapshot.");
+            }
+            pointer.blockId = entry->second;
+        }
+    };
+
+    renumber(header->pointerToParent, true);
+    for (unsigned int i = 0; i <= maxKeys; i++) {
+        bool pointsToNode;
+        getPointerTarget(header, ptrArr, kind, maxKeys, i, pointsToNode);
+        renumber(ptrArr[i], pointsToNode);
+    }
+}
+
+// The offsets of the fields of a node depend on its NodeLayout, and are worked out once by the constructor
+/**
+ * @brief Gets the keys of a node.
+ * @param node The node.
+ * @return The array of keys of the node.
+ */
+float* BPlusTree::getKeys(void* node) {
+    return (float*) ((char*) node + keysOffset);
+}
+
+/**
+ * @brief Gets the pointers of a node.
+ * @param node The node.
+ * @return The array of pointers of the node.
+ */
+pointerBlockPair* BPlusTree::getPointers(void* node) {
+    return (pointerBlockPair*) ((char*) node + pointersOffset);
+}
+
+// Aggregates are stored last in a node, one for each pointer of the node
+/**
+ * @brief Gets the aggregates of the entries of a node.
+ * @param node The node.
+ * @return The array of aggregates of the node.
+ */
+EntryAggregate* BPlusTree::getAggregates(void* node) {
+    return (EntryAggregate*) ((char*) node + aggregatesOffset);
+}
+
+// A leaf has one aggregate per key, a non-leaf node one per child
+/**
+ * @brief Sums the aggregates of all entries of a node.
+ * @param node The node.
+ * @return The aggregate of the subtree of the node.
+ */
+EntryAggregate BPlusTree::getNodeTotal(void* node) {
+    NodeHeader* header = (NodeHeader*) node;
+    EntryAggregate* aggregateArr = getAggregates(node);
+    unsigned int numEntries = header->isLeaf ? header->numKeys : header->numKeys + 1;
+
+    EntryAggregate total = {0, 0};
+    for (unsigned int i = 0; i < numEntries; i++) {
+        total.count += aggregateArr[i].count;
+        total.sum += aggregateArr[i].sum;
+    }
+    return total;
+}
+
+/**
+ * @brief Recomputes the aggregates of the entries of a non-leaf node from the totals of its children.
+ * @param node The non-leaf node.
+ */
+void BPlusTree::recomputeAggregates(void* node) {
+    pointerBlockPair* ptrArr = getPointers(node);
+    EntryAggregate* aggregateArr = getAggregates(node);
+    unsigned int numKeys = *(unsigned int*) node;
+    for (unsigned int i = 0; i <= numKeys; i++) {
+        aggregateArr[i] = getNodeTotal(getNode(ptrArr[i]));
+    }
+}
+
+// Walks up the parent pointers from a changed node, recomputing every node on the way to the root
+/**
+ * @brief Recomputes the aggregates of a node (if it is a non-leaf node) and of all of its ancestors.
+ * @param node The node that has changed.
+ */
+void BPlusTree::refreshAggregates(void* node) {
+    if (!hasAggregates) {
+        return;
+    }
+    if (!((NodeHeader*) node)->isLeaf) {
+        recomputeAggregates(node);
+    }
+    void* parentNode = getNode(((NodeHeader*) node)->pointerToParent);
+    while (parentNode != nullptr) {
+        recomputeAggregates(parentNode);
+        parentNode = getNode(((NodeHeader*) parentNode)->pointerToParent);
+    }
+}
+
+// Descends towards a key like findNode(), adding up the aggregates of every entry left of the path
+/**
+ * @brief Computes the COUNT and SUM of the payload column over the records whose key is smaller than (or equal to) a key.
+ * @param points_home The key value.
+ * @param inclusive Whether the records with the key itself are included.
+ * @return The aggregate of the records before the key.
+ */
+EntryAggregate BPlusTree::getPrefixAggregate(float points_home, bool inclusive) {
+    EntryAggregate prefix = {0, 0};
+    void* node = root;
+
+    for (unsigned int level = 0; level <= height; level++) {
+        numIndexAccessed++;
+        pointerBlockPair* ptrArr = getPointers(node);
+        float* pointsHomeArr = getKeys(node);
+        EntryAggregate* aggregateArr = getAggregates(node);
+        unsigned int numKeys = *(unsigned int*) node;
+
+        // Every child left of the one followed only holds keys smaller than the key
+        // Within the leaf, every key counted is smaller than (or equal to) the key
+        unsigned int i;
+        if (level < height || inclusive) {
+            i = KeySearch::countLessOrEqual(pointsHomeArr, numKeys, points_home);
+        } else {
+            i = KeySearch::countLess(pointsHomeArr, numKeys, points_home);
+        }
+        for (unsigned int j = 0; j < i; j++) {
+            prefix.count += aggregateArr[j].count;
+            prefix.sum += aggregateArr[j].sum;
+        }
+        node = getNode(ptrArr[i]);
+    }
+    return prefix;
+}
+
+/**
+ * @brief Computes the COUNT and SUM of the payload column over the records whose key lies within a range.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @return The COUNT and SUM of the payload column over the range.
+ */
+AggregateResult BPlusTree::aggregateRange(float pointsHomeStart, float pointsHomeEnd) {
+    numIndexAccessed = 0;
+    AggregateResult result;
+    if (!hasAggregates || pointsHomeStart > pointsHomeEnd) {
+        return result;
+    }
+
+    // Every insert into a tree with aggregates holds the root latch exclusively, so holding it shared keeps both descents consistent
+    shared_lock<shared_mutex> treeLock(treeLatch, defer_lock);
+    shared_lock<shared_mutex> rootLock(rootLatch, defer_lock);
+    if (isConcurrent) {
+        treeLock.lock();
+        rootLock.lock();
+    }
+
+    EntryAggregate upToEnd = getPrefixAggregate(pointsHomeEnd, true);
+    EntryAggregate beforeStart = getPrefixAggregate(pointsHomeStart, false);
+    result.count = upToEnd.count - beforeStart.count;
+    result.sum = upToEnd.sum - beforeStart.sum;
+    return result;
+}
+
+// Counting the first leaves of the range is exact for narrow ranges and point lookups, whose keys may have many duplicates
+// A wider range is extrapolated from the fractions of the tree before its two boundaries
+/**
+ * @brief Estimates the size of a key range without collecting its records.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param totalRecords The number of records indexed by the tree.
+ * @return The estimated size of the range.
+ */
+RangeEstimate BPlusTree::estimateRange(float pointsHomeStart, float pointsHomeEnd, double totalRecords) {
+    if (pointsHomeStart > pointsHomeEnd) {
+        return {0, 0, true};
+    }
+    if (hasAggregates) {
+        double numRecords = aggregateRange(pointsHomeStart, pointsHomeEnd).count;
+        double numLeaves = totalRecords > 0 ? ceil((numNodes - numInternalNodes) * numRecords / totalRecords) : 0;
+        return {numRecords, max(1.0, numLeaves), true};
+    }
+
+    shared_lock<shared_mutex> treeLock(treeLatch, defer_lock);
+    if (isConcurrent) {
+        treeLock.lock();
+    }
+
+    // Count the records of the first leaves of the range, latching them like findRecord()
+    void* leaf = isConcurrent ? findLeafShared(pointsHomeStart) : findNode(pointsHomeStart);
+    double numRecords = 0;
+    unsigned int numLeaves = 0;
+    bool isRangeEnded = false;
+    while (true) {
+        unsigned int numKeys = *(unsigned int*) leaf;
+        pointerBlockPair* ptrArr = getPointers(leaf);
+        float* pointsHomeArr = getKeys(leaf);
+        unsigned int i = numLeaves == 0 ? KeySearch::countLess(pointsHomeArr, numKeys, pointsHomeStart) : 0;
+        numLeaves++;
+        for (; i < numKeys && pointsHomeArr[i] <= pointsHomeEnd; i++) {
+            if (ptrArr[i].recordID == -1) {
+                for (void* overflowNode = getNode(ptrArr[i]); overflowNode != nullptr; overflowNode = getNode(getPointers(overflowNode)[maxKeys])) {
+                    numRecords += *(unsigned int*) overflowNode;
+                }
+            } else {
+                numRecords++;
+            }
+        }
+        if (i < numKeys || ptrArr[maxKeys].blockId == -1) {
+            isRangeEnded = true;
+            break;
+        }
+        if (numLeaves == ESTIMATE_LEAF_BUDGET) {
+            break;
+        }
+        void* nextLeaf = getNode(ptrArr[maxKeys]);
+        if (isConcurrent) {
+            getLatch(nextLeaf).lock_shared();
+            getLatch(leaf).unlock_shared();
+        }
+        leaf = nextLeaf;
+    }
+    if (isConcurrent) {
+        getLatch(leaf).unlock_shared();
+    }
+    if (isRangeEnded) {
+        return {numRecords, (double) numLeaves, true};
+    }
+
+    double fraction = getKeyFraction(pointsHomeEnd, true) - getKeyFraction(pointsHomeStart, false);
+    return {max(numRecords, fraction * totalRecords), max((double) numLeaves, fraction * (numNodes - numInternalNodes)), false};
+}
+
+/**
+ * @brief Estimates the fraction of the leaf entries that come before a key.
+ * @param points_home The key value.
+ * @param inclusive Whether the entry of the key itself counts as coming before it.
+ * @return The fraction, between 0 and 1.
+ */
+double BPlusTree::getKeyFraction(float points_home, bool inclusive) {
+    if (isConcurrent) {
+        rootLatch.lock_shared();
+    }
+    void* node = root;
+    if (isConcurrent) {
+        getLatch(node).lock_shared();
+        rootLatch.unlock_shared();
+    }
+
+    // Each level narrows the fraction down to the share of the child followed
+    double fraction = 0;
+    double width = 1;
+    while (!((NodeHeader*) node)->isLeaf) {
+        unsigned int numKeys = *(unsigned int*) node;
+        unsigned int i = KeySearch::countLessOrEqual(getKeys(node), numKeys, points_home);
+        fraction += width * i / (numKeys + 1);
+        width /= numKeys + 1;
+        void* child = getNode(getPointers(node)[i]);
+        if (isConcurrent) {
+            getLatch(child).lock_shared();
+            getLatch(node).unlock_shared();
+        }
+        node = child;
+    }
+    unsigned int numKeys = *(unsigned int*) node;
+    if (numKeys > 0) {
+        unsigned int i = inclusive ? KeySearch::countLessOrEqual(getKeys(node), numKeys, points_home)
+                                   : KeySearch::countLess(getKeys(node), numKeys, points_home);
+        fraction += width * i / numKeys;
+    }
+    if (isConcurrent) {
+        getLatch(node).unlock_shared();
+    }
+    return fraction;
+}
+
 // Print the contents of a specific index block in the B+ Tree
 // Used for experiments
 // Functions for Experiments/Visualization
@@ -78,8 +603,7 @@ void* BPlusTree::getNewNode(bool isLeaf, bool isOverflow) {
  */
 int BPlusTree::printIndexBlock(void* node, ofstream &output) {
     int numKeys = *(unsigned int*)node;
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
-    float* pointsHomeArr = (float*) (ptrArr + maxKeys + 1);
+    float* pointsHomeArr = getKeys(node);
 
     cout << " | ";
     if (output.is_open())
@@ -118,40 +642,77 @@ list<pointerBlockPair> BPlusTree::findRecord(float pointsHomeStart, float points
     auto startTime = std::chrono::high_resolution_clock::now();
 
     numIndexAccessed = 0;
+    numOverflowNodesAccessed = 0;
     int numDataBlockAccessed = 0;
 
+    // In concurrent use, the leaves are latched in shared mode from left to right, each latch being released once the next leaf is latched
+    // With optimistic reads, no latch is taken at all and the versions of the nodes are validated instead, unless the lookup keeps restarting
     list<pointerBlockPair> results;
-    void* currNode = findNode(pointsHomeStart, root, 0, output, false);
+    bool isFound = isOptimistic && findRecordOptimistic(pointsHomeStart, pointsHomeEnd, results);
+    shared_lock<shared_mutex> treeLock(treeLatch, defer_lock);
+    if (isConcurrent && !isFound) {
+        treeLock.lock();
+    }
 
-    while (currNode != nullptr) {
-        // Extract information from the current node
-        unsigned int numKeys = *(unsigned int*)currNode;
-        pointerBlockPair* ptrArr = (pointerBlockPair*)(((NodeHeader*)currNode) + 1);
-        float* numVotesArr = (float*)(ptrArr + maxKeys + 1);
-        int i = 0;
-
-        // Continue iterating when key is smaller than search key and the current non-full node has not reached the end
-        while (i < numKeys && numVotesArr[i] < pointsHomeEnd) {
-            if (numVotesArr[i] >= pointsHomeStart) { // Check if key is greater than starting key
-                // Track the number of index and data blocks accessed
-                numIndexAccessed++;
-
-                // Check if it's a valid data block, not an overflow node
-                if (ptrArr[i].blockAddress != nullptr) {
-                    results.push_back(ptrArr[i]);
-                    numDataBlockAccessed++;
+    if (isFound) {
+        numDataBlockAccessed = results.size();
+    } else {
+        void* currNode = isConcurrent ? findLeafShared(pointsHomeStart) : findNode(pointsHomeStart);
+        bool isFirstLeaf = true;
+
+        while (currNode != nullptr) {
+            // Extract information from the current node
+            unsigned int numKeys = *(unsigned int*)currNode;
+            pointerBlockPair* ptrArr = getPointers(currNode);
+            float* numVotesArr = getKeys(currNode);
+
+            // Within the first leaf, skip straight to the first key not smaller than the starting key
+            int i = isFirstLeaf ? KeySearch::countLess(numVotesArr, numKeys, pointsHomeStart) : 0;
+            isFirstLeaf = false;
+
+            // Continue iterating when key is not larger than the ending key and the current non-full node has not reached the end
+            while (i < numKeys && numVotesArr[i] <= pointsHomeEnd) {
+                if (numVotesArr[i] >= pointsHomeStart) { // Check if key is greater than starting key
+                    // Track the number of index and data blocks accessed
+                    numIndexAccessed++;
+
+                    if (ptrArr[i].recordID == -1) {
+                        // Duplicate key, collect every record held in its overflow nodes
+                        void* overflowNode = getNode(ptrArr[i]);
+                        while (overflowNode != nullptr) {
+                            numOverflowNodesAccessed++;
+                            unsigned int numRecords = *(unsigned int*)overflowNode;
+                            pointerBlockPair* ptrArrOverflow = getPointers(overflowNode);
+                            for (unsigned int j = 0; j < numRecords; j++) {
+                                results.push_back(ptrArrOverflow[j]);
+                                numDataBlockAccessed++;
+                            }
+                            overflowNode = getNode(ptrArrOverflow[maxKeys]);
+                        }
+                    } else {
+                        results.push_back(ptrArr[i]);
+                        numDataBlockAccessed++;
+                    }
                 }
+
+                // Move to the next key
+                i++;
             }
 
-            // Move to the next key
-            i++;
+            // Traverse to the next leaf node if available
+            if (i < numKeys || ptrArr[maxKeys].blockId == -1) {
+                break; // If the ending key has been passed or there's no next leaf node, break out of the loop
+            }
+            void* nextNode = getNode(ptrArr[maxKeys]);
+            if (isConcurrent) {
+                getLatch(nextNode).lock_shared();
+                getLatch(currNode).unlock_shared();
+            }
+            currNode = nextNode;
         }
-
-        // Traverse to the next leaf node if available
-        if (ptrArr[maxKeys].blockAddress == nullptr) {
-            break; // If there's no next leaf node, break out of the loop
+        if (isConcurrent) {
+            getLatch(currNode).unlock_shared();
         }
-        currNode = ptrArr[maxKeys].blockAddress;
     }
 
     auto endTime = std::chrono::high_resolution_clock::now();
@@ -159,6 +720,7 @@ list<pointerBlockPair> BPlusTree::findRecord(float pointsHomeStart, float points
 
     if (output.is_open()) {
         output << "Total number of index nodes accessed: " << numIndexAccessed << "\n";
+        output << "Total number of overflow nodes accessed: " << numOverflowNodesAccessed << "\n";
         output << "Total number of data blocks accessed: " << numDataBlockAccessed << "\n";
         output << "Running time for Retrieval Process: " << elapsedTime.count() << " microseconds \n";
     }
@@ -166,6 +728,115 @@ list<pointerBlockPair> BPlusTree::findRecord(float pointsHomeStart, float points
     return results;
 }
 
+// Separators are gathered one level at a time from the nodes overlapping the range, stopping above the leaves
+// In concurrent use, each node is latched in shared mode while its keys are read, and treeLatch keeps nodes from being freed
+/**
+ * @brief Splits a key range into morsels at the separator keys of the non-leaf nodes.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param numMorsels The number of morsels wanted.
+ * @return The boundaries of the morsels in increasing order.
+ */
+vector<float> BPlusTree::splitRange(float pointsHomeStart, float pointsHomeEnd, unsigned int numMorsels) {
+    shared_lock<shared_mutex> treeLock(treeLatch, defer_lock);
+    shared_lock<shared_mutex> rootLock(rootLatch, defer_lock);
+    if (isConcurrent) {
+        treeLock.lock();
+        rootLock.lock();
+    }
+
+    vector<float> separators;
+    vector<void*> levelNodes = {root};
+    unsigned int levelsLeft = height;
+    if (isConcurrent) {
+        rootLock.unlock();
+    }
+    while (levelsLeft > 0 && pointsHomeStart < pointsHomeEnd) {
+        // Keys within (pointsHomeStart, pointsHomeEnd] separate the children that overlap the range
+        separators.clear();
+        vector<void*> children;
+        for (void* node : levelNodes) {
+            if (isConcurrent) {
+                getLatch(node).lock_shared();
+            }
+            unsigned int numKeys = *(unsigned int*) node;
+            float* pointsHomeArr = getKeys(node);
+            pointerBlockPair* ptrArr = getPointers(node);
+            unsigned int first = KeySearch::countLessOrEqual(pointsHomeArr, numKeys, pointsHomeStart);
+            unsigned int last = KeySearch::countLessOrEqual(pointsHomeArr, numKeys, pointsHomeEnd);
+            for (unsigned int i = first; i <= last; i++) {
+                if (i < last) {
+                    separators.push_back(pointsHomeArr[i]);
+                }
+                children.push_back(getNode(ptrArr[i]));
+            }
+            if (isConcurrent) {
+                getLatch(node).unlock_shared();
+            }
+        }
+        levelsLeft--;
+        if (separators.size() + 1 >= numMorsels || levelsLeft == 0) {
+            break;
+        }
+        levelNodes = move(children);
+    }
+
+    // Keep numMorsels - 1 evenly spaced separators at most
+    vector<float> boundaries = {pointsHomeStart};
+    size_t numSeparators = min<size_t>(separators.size(), numMorsels > 0 ? numMorsels - 1 : 0);
+    for (size_t i = 1; i <= numSeparators; i++) {
+        boundaries.push_back(separators[i * separators.size() / (numSeparators + 1)]);
+    }
+    boundaries.push_back(pointsHomeEnd);
+    return boundaries;
+}
+
+// Morsel-driven scan: each worker looks up the keys of one morsel at a time, stealing morsels from the other workers once it runs out
+// A morsel ends just below its upper boundary, which is the first key of the next morsel
+/**
+ * @brief Finds the records within a range of key values, one morsel of leaves at a time on a thread pool.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param pool The thread pool running the morsels.
+ * @param consumer Called with the number of the morsel, the number of the worker and the records of the morsel.
+ * @return The number of morsels.
+ */
+size_t BPlusTree::scanParallel(float pointsHomeStart, float pointsHomeEnd, ThreadPool& pool,
+                               const function<void(size_t morsel, unsigned int worker, list<pointerBlockPair>& records)>& consumer) {
+    if (pointsHomeStart > pointsHomeEnd) {
+        return 0;
+    }
+    vector<float> boundaries = splitRange(pointsHomeStart, pointsHomeEnd, pool.numThreads * MORSELS_PER_THREAD);
+    size_t numMorsels = boundaries.size() - 1;
+    pool.run(numMorsels, [&](size_t morsel, unsigned int worker) {
+        bool isLastMorsel = morsel + 1 == numMorsels;
+        float morselEnd = isLastMorsel ? boundaries[morsel + 1] : nextafterf(boundaries[morsel + 1], -INFINITY);
+        ofstream noOutput;
+        list<pointerBlockPair> records = findRecord(boundaries[morsel], morselEnd, noOutput);
+        consumer(morsel, worker, records);
+    });
+    return numMorsels;
+}
+
+/**
+ * @brief Finds the records within a range of key values with scanParallel().
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param pool The thread pool running the morsels.
+ * @return The pointer-block pairs of the records found, in key order.
+ */
+list<pointerBlockPair> BPlusTree::findRecordParallel(float pointsHomeStart, float pointsHomeEnd, ThreadPool& pool) {
+    vector<list<pointerBlockPair>> morselRecords(pool.numThreads * MORSELS_PER_THREAD);
+    size_t numMorsels = scanParallel(pointsHomeStart, pointsHomeEnd, pool, [&](size_t morsel, unsigned int, list<pointerBlockPair>& records) {
+        morselRecords[morsel].swap(records);
+    });
+    list<pointerBlockPair> results;
+    for (size_t morsel = 0; morsel < numMorsels; morsel++) {
+        results.splice(results.end(), morselRecords[morsel]);
+    }
+    return results;
+}
+
 /**
  * @brief Gets the maximum key value that is less than or equal to the specified maxVal.
  * @param maxVal The maximum value to compare against.
@@ -184,135 +855,493 @@ int BPlusTree::getMax(float maxVal, float start){
 
 
 // Finds the appropiate node to be used for retrieval/insertion/deletion
-// Starts from the root node and recursively calls findNode() every time it goes down a level
-// Terminating condition occurs when a leaf node is reached
+// Starts from the root node and iteratively goes down one level at a time until a leaf node is reached
 // This DOES NOT mean that the key is definitely present in the node, iteration through the node still needs to be done
+// Tracing of the visited nodes is left to nodeVisitObserver, so a lookup without an observer only compares keys
 /**
- * @brief Finds the node containing a specific key value within the B+ tree.
+ * @brief Finds the leaf node that may contain a specific key value within the B+ tree.
  * @param points_home The key value to search for.
- * @param node The current node being searched.
- * @param currHeight The current height in the B+ tree.
- * @param output The output file stream for logging.
- * @param willPrint Indicates whether to print debug information.
- * @return A pointer to the node containing the key.
+ * @return A pointer to the leaf node for the key.
  */
-void* BPlusTree::findNode(float points_home , void* node, unsigned int currHeight, ofstream &output, bool willPrint) {
+void* BPlusTree::findNode(float points_home) {
+    void* node = root;
 
-    numIndexAccessed++;
-
-    // Print index blocks to screen and file
-    if(willPrint){
-        if (output.is_open()) {
-            printIndexBlock(node, output);
-            cout << endl;
-            output << endl;
+    for (unsigned int level = 0; level < height; level++) {
+        if (nodeVisitObserver) {
+            nodeVisitObserver(node, level);
         }
+
+        // Search into the pointer right of the last key that is not larger than points_home
+        pointerBlockPair* ptrArr = getPointers(node);
+        float* pointsHomeArr = getKeys(node);
+        unsigned int i = KeySearch::countLessOrEqual(pointsHomeArr, *((unsigned int*) node), points_home);
+        node = getNode(ptrArr[i]);
     }
 
-    // return terminal node
-    if (currHeight == height) {
-        return node;
+    if (nodeVisitObserver) {
+        nodeVisitObserver(node, height);
     }
+    numIndexAccessed += height + 1;
 
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) node ) + 1 );
-    float* pointsHomeArr = (float*) (ptrArr + maxKeys + 1);
-    unsigned int numKeys = *((unsigned int*) node);
+    return node;
+}
 
-    for (int i = 0; i <= numKeys - 1; i++) {
-        if (points_home < pointsHomeArr[i]) {
-            return findNode(points_home, ptrArr[i].blockAddress, ++currHeight, output, willPrint); // Search into pointer left of current index
-        } else {
-            if (i != numKeys - 1) {
-                continue; // compare with next numVotes if the last numVotes has not been reached
-            } else {
-                return findNode(points_home, ptrArr[i+1].blockAddress, ++currHeight, output, willPrint); // Search into pointer right of last numVotes
+// Nodes are latched by the ID of their block, so the latch and version tables have one entry for every block of the disk
+/**
+ * @brief Lets several threads look up and insert records at the same time, by giving every node a reader/writer latch and a version.
+ * @param optimisticReads Whether lookups validate node versions instead of coupling shared latches.
+ */
+void BPlusTree::enableConcurrency(bool optimisticReads) {
+    if (!isConcurrent) {
+        nodeLatches = vector<shared_mutex>(nodeDisk->numOfBlocks);
+        nodeVersions = vector<atomic<uint64_t>>(nodeDisk->numOfBlocks);
+        isConcurrent = true;
+    }
+    isOptimistic = optimisticReads && !hasAggregates; // every insert holds the root latch when the ancestors' aggregates change
+}
+
+/**
+ * @brief Gets the latch of a node.
+ * @param node The node.
+ * @return The reader/writer latch of the node.
+ */
+shared_mutex& BPlusTree::getLatch(void* node) {
+    return nodeLatches[getNodeId(node)];
+}
+
+// The version is made odd before the node is changed and even again once it has been changed, like a sequence lock
+/**
+ * @brief Latches a node exclusively and makes its version odd.
+ * @param node The node.
+ */
+void BPlusTree::lockNode(void* node) {
+    getLatch(node).lock();
+    nodeVersions[getNodeId(node)].fetch_add(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * @brief Makes the version of a node even again and releases its exclusive latch.
+ * @param node The node.
+ */
+void BPlusTree::unlockNode(void* node) {
+    nodeVersions[getNodeId(node)].fetch_add(1, memory_order_release);
+    getLatch(node).unlock();
+}
+
+/**
+ * @brief Reads the version of a node before reading the node without latching it.
+ * @param node The node.
+ * @return The version of the node, which is odd if the node is being changed.
+ */
+uint64_t BPlusTree::readVersion(void* node) {
+    return nodeVersions[getNodeId(node)].load(memory_order_acquire);
+}
+
+// Deletions and bulk loads change nodes without latching them, so the version of the tree is checked along with the node
+/**
+ * @brief Checks that neither a node nor the whole tree has changed since their versions were read.
+ * @param node The node.
+ * @param version The version of the node, from readVersion().
+ * @param treeVer The version of the tree.
+ * @return True if everything read from the node in between is consistent.
+ */
+bool BPlusTree::isUnchanged(void* node, uint64_t version, uint64_t treeVer) {
+    atomic_thread_fence(memory_order_acquire);
+    return nodeVersions[getNodeId(node)].load(memory_order_relaxed) == version && treeVersion.load(memory_order_relaxed) == treeVer;
+}
+
+// Latch coupling: the latch of a child is taken before the latch of its parent is released, so a node cannot be split under a reader
+// The root latch is only held until the root itself is latched, since a new root may be created by a split
+/**
+ * @brief Descends to the leaf node that may contain a key, coupling shared latches on the way.
+ * @param points_home The key value to search for.
+ * @return The leaf node for the key, latched in shared mode.
+ */
+void* BPlusTree::findLeafShared(float points_home) {
+    rootLatch.lock_shared();
+    void* node = root;
+    getLatch(node).lock_shared();
+    rootLatch.unlock_shared();
+
+    unsigned int numLevels = 1;
+    while (!((NodeHeader*) node)->isLeaf) {
+        unsigned int i = KeySearch::countLessOrEqual(getKeys(node), *(unsigned int*) node, points_home);
+        void* child = getNode(getPointers(node)[i]);
+        getLatch(child).lock_shared();
+        getLatch(node).unlock_shared();
+        node = child;
+        numLevels++;
+    }
+    numIndexAccessed += numLevels;
+    return node;
+}
+
+// Optimistic lock coupling: instead of latching a node, its version is read before and validated after reading its pointer
+// A pointer is only followed once the node it was read from is known to be unchanged, so only consistent pointers are followed
+// The number of keys is bounded by maxKeys, so reading a node while it changes never reads outside of it
+/**
+ * @brief Descends to the leaf node that may contain a key without taking any latch.
+ * @param points_home The key value to search for.
+ * @param treeVer The version of the tree when the lookup started.
+ * @param leafVersion Set to the version of the leaf.
+ * @param numLevels Incremented by the number of nodes visited.
+ * @param numRestarts Incremented every time the descent restarts or waits for a node being changed.
+ * @return The leaf node for the key, or nullptr if the tree has changed since treeVer or the descent restarted too often.
+ */
+void* BPlusTree::findLeafOptimistic(float points_home, uint64_t treeVer, uint64_t& leafVersion, int& numLevels, int& numRestarts) {
+    for (; treeVersion.load(memory_order_acquire) == treeVer && numRestarts <= MAX_OPTIMISTIC_RESTARTS; numRestarts++) {
+        // Read the root and its version while no split is replacing the root
+        uint64_t rootVer = rootVersion.load(memory_order_acquire);
+        if (rootVer % 2 == 1) {
+            this_thread::yield();
+            continue;
+        }
+        void* node = root;
+        uint64_t version = readVersion(node);
+        atomic_thread_fence(memory_order_acquire);
+        if (version % 2 == 1 || rootVersion.load(memory_order_relaxed) != rootVer) {
+            this_thread::yield();
+            continue;
+        }
+        numLevels++;
+
+        bool isRestarted = false;
+        while (!((NodeHeader*) node)->isLeaf) {
+            unsigned int numKeys = min(*(unsigned int*) node, maxKeys);
+            unsigned int i = KeySearch::countLessOrEqual(getKeys(node), numKeys, points_home);
+            pointerBlockPair childPtr = getPointers(node)[i];
+            if (!isUnchanged(node, version, treeVer)) {
+                isRestarted = true;
+                break;
+            }
+            void* child = getNode(childPtr);
+            uint64_t childVersion = readVersion(child);
+
+            // The parent must still be unchanged once the version of the child is read, or the child may have been split
+            if (childVersion % 2 == 1 || !isUnchanged(node, version, treeVer)) {
+                isRestarted = true;
+                break;
             }
+            node = child;
+            version = childVersion;
+            numLevels++;
+        }
+        if (!isRestarted) {
+            leafVersion = version;
+            return node;
+        }
+        this_thread::yield();
+    }
+    return nullptr;
+}
+
+// The records of each leaf are collected into a separate list, which is only kept once the leaf is validated
+// When a leaf has changed, the lookup descends again to the last key kept and skips it, so no record is collected twice
+// A lookup that keeps restarting gives up, so that a reader never spins for long behind a writer holding a latch
+/**
+ * @brief Collects the records whose key lies within a range without taking any latch.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param results Set to the pointer-block pairs of the records found.
+ * @return True if the lookup finished, false if it gave up after restarting MAX_OPTIMISTIC_RESTARTS times.
+ */
+bool BPlusTree::findRecordOptimistic(float pointsHomeStart, float pointsHomeEnd, list<pointerBlockPair>& results) {
+    int numNodesVisited = 0;
+    int numOverflowNodesVisited = 0;
+    int numRestarts = 0;
+
+    bool isDone = false;
+    while (!isDone) {
+        // Wait for any deletion or bulk load to finish, and start over if one runs during the lookup
+        if (numRestarts > MAX_OPTIMISTIC_RESTARTS) {
+            results.clear();
+            return false;
+        }
+        uint64_t treeVer = treeVersion.load(memory_order_acquire);
+        if (treeVer % 2 == 1) {
+            numRestarts++;
+            this_thread::yield();
+            continue;
+        }
+        results.clear();
+        float resumeKey = pointsHomeStart;
+        bool isResumeKeyKept = false;
+
+        while (!isDone) {
+            uint64_t version;
+            void* leaf = findLeafOptimistic(resumeKey, treeVer, version, numNodesVisited, numRestarts);
+            if (leaf == nullptr) {
+                break;
+            }
+
+            bool isFirstLeaf = true;
+            while (true) {
+                unsigned int numKeys = min(*(unsigned int*) leaf, maxKeys);
+                pointerBlockPair* ptrArr = getPointers(leaf);
+                float* pointsHomeArr = getKeys(leaf);
+                list<pointerBlockPair> leafResults;
+                int numLeafOverflowNodes = 0;
+                float lastKey = resumeKey;
+                int numLeafKeys = 0;
+
+                // Within the first leaf, skip the keys before the starting key, or up to the last key kept
+                unsigned int i = 0;
+                if (isFirstLeaf) {
+                    i = isResumeKeyKept ? KeySearch::countLessOrEqual(pointsHomeArr, numKeys, resumeKey)
+                                        : KeySearch::countLess(pointsHomeArr, numKeys, resumeKey);
+                }
+                while (i < numKeys && pointsHomeArr[i] <= pointsHomeEnd) {
+                    if (ptrArr[i].recordID == -1) {
+                        // The overflow nodes of a key only change while its leaf is latched, so the version of the leaf covers them
+                        pointerBlockPair overflowPtr = ptrArr[i];
+                        unsigned int maxOverflowNodes = numOverflowNodes;
+                        while (overflowPtr.blockId >= 0 && overflowPtr.blockId < nodeDisk->numOfBlocks
+                               && numLeafOverflowNodes <= (int) maxOverflowNodes) {
+                            void* overflowNode = getNode(overflowPtr);
+                            numLeafOverflowNodes++;
+                            unsigned int numRecords = min(*(unsigned int*) overflowNode, maxKeys);
+                            pointerBlockPair* ptrArrOverflow = getPointers(overflowNode);
+                            for (unsigned int j = 0; j < numRecords; j++) {
+                                leafResults.push_back(ptrArrOverflow[j]);
+                            }
+                            overflowPtr = ptrArrOverflow[maxKeys];
+                        }
+                    } else {
+                        leafResults.push_back(ptrArr[i]);
+                    }
+                    lastKey = pointsHomeArr[i];
+                    numLeafKeys++;
+                    i++;
+                }
+                pointerBlockPair nextPtr = ptrArr[maxKeys];
+                bool isLastLeaf = i < numKeys || nextPtr.blockId == -1;
+                if (!isUnchanged(leaf, version, treeVer)) {
+                    numRestarts++;
+                    break;
+                }
+
+                // Keep the records of the leaf, which were read while it was unchanged
+                if (!leafResults.empty()) {
+                    resumeKey = lastKey;
+                    isResumeKeyKept = true;
+                }
+                results.splice(results.end(), leafResults);
+                numNodesVisited += numLeafKeys;
+                numOverflowNodesVisited += numLeafOverflowNodes;
+                if (isLastLeaf) {
+                    isDone = true;
+                    break;
+                }
+
+                // Move to the next leaf, which must still be the next leaf once its version is read
+                void* nextLeaf = getNode(nextPtr);
+                uint64_t nextVersion = readVersion(nextLeaf);
+                if (nextVersion % 2 == 1 || !isUnchanged(leaf, version, treeVer)) {
+                    numRestarts++;
+                    break;
+                }
+                leaf = nextLeaf;
+                version = nextVersion;
+                isFirstLeaf = false;
+            }
+        }
+    }
+
+    numIndexAccessed += numNodesVisited;
+    numOverflowNodesAccessed += numOverflowNodesVisited;
+    return true;
+}
+
+// Inserts a key into the B+ Tree if it exists
+// Accounts for duplicate keys and creates overflow nodes to hold duplicate keys if required
+// Leaf nodes will only hold unique key values, which may have pointers to overflow nodes if multiple records have the same index
+// Calls splitLeafNode() if number of keys exceeds the maximum number of keys the leaf node can hold
+/**
+ * @brief Inserts a record into the B+ tree.
+ * @param points_home The key value of the record.
+ * @param record The pointer-block pair representing the record.
+ */
+void BPlusTree::insertRecord(float points_home, pointerBlockPair record) {
+    if (isConcurrent) {
+        insertRecordConcurrently(points_home, record);
+        return;
+    }
+    insertIntoLeaf(findNode(points_home), points_home, record);
+}
+
+/**
+ * @brief Inserts a record into the leaf node for its key.
+ * @param nodeToInsertAt The leaf node for the key of the record.
+ * @param points_home The key value of the record.
+ * @param record The pointer-block pair representing the record.
+ */
+void BPlusTree::insertIntoLeaf(void* nodeToInsertAt, float points_home, pointerBlockPair record) {
+
+    count++;
+    int numKeys = *(unsigned int*)nodeToInsertAt;
+    pointerBlockPair* ptrArr = getPointers(nodeToInsertAt);
+    float* points_homeArr = getKeys(nodeToInsertAt);
+
+    // Find position within node of the first key not smaller than the new key
+    int i = KeySearch::countLess(points_homeArr, numKeys, points_home);
+
+    // CASE 1: Duplicate key, add the record to the overflow nodes of the existing key
+    if (i < numKeys && points_home == points_homeArr[i]) {
+        insertDuplicate(&ptrArr[i], record);
+        if (hasAggregates) {
+            EntryAggregate* aggregateArr = getAggregates(nodeToInsertAt);
+            aggregateArr[i].count++;
+            aggregateArr[i].sum += payloadReader(record);
+            refreshAggregates(nodeToInsertAt);
+        }
+        return;
+    }
+
+    // CASE 2: Unique key, but number of keys after insertion to node exceeds max number of keys allowed
+    if (numKeys == maxKeys){
+        splitLeafNode(points_home, record, nodeToInsertAt, ptrArr, points_homeArr);
+        refreshAggregates(nodeToInsertAt);
+        return;
+    }
+
+    // CASE 3: Unique key, and node has sufficient space to hold new key
+    EntryAggregate* aggregateArr = hasAggregates ? getAggregates(nodeToInsertAt) : nullptr;
+    for (int j = numKeys; j > i; j--) { // Shift current keys back to accomondate new key
+        points_homeArr[j] = points_homeArr[j-1];
+        ptrArr[j] = ptrArr[j-1];
+        if (aggregateArr != nullptr) {
+            aggregateArr[j] = aggregateArr[j-1];
         }
     }
-
-    return nullptr;
+    points_homeArr[i] = points_home;
+    ptrArr[i] = record;
+    (*(unsigned int*)nodeToInsertAt)++; //Increment number of records in leaf node
+    if (aggregateArr != nullptr) {
+        aggregateArr[i] = {1, payloadReader(record)};
+        refreshAggregates(nodeToInsertAt);
+    }
 }
 
-// Inserts a key into the B+ Tree if it exists
-// Accounts for duplicate keys and creates overflow nodes to hold duplicate keys if required
-// Leaf nodes will only hold unique key values, which may have pointers to overflow nodes if multiple records have the same index
-// Calls splitLeafNode() if number of keys exceeds the maximum number of keys the leaf node can hold
+// Inserts a record while other threads may be looking up or inserting records
+// Most inserts do not split their leaf, so the tree is first descended with shared latches and only the leaf is latched exclusively
+// If the leaf is full, the insert starts again from the root with exclusive latches, keeping the latches of the nodes that may split
 /**
- * @brief Inserts a record into the B+ tree.
+ * @brief Inserts a record into the B+ tree while other threads may be using it.
  * @param points_home The key value of the record.
  * @param record The pointer-block pair representing the record.
  */
-void BPlusTree::insertRecord(float points_home, pointerBlockPair record) {
+void BPlusTree::insertRecordConcurrently(float points_home, pointerBlockPair record) {
+    shared_lock<shared_mutex> treeLock(treeLatch);
+
+    // With aggregates, every ancestor of the leaf changes, so there is no point in trying the shared descent
+    if (!hasAggregates) {
+        rootLatch.lock_shared();
+        void* node = root;
+        ((NodeHeader*) node)->isLeaf ? lockNode(node) : getLatch(node).lock_shared();
+        rootLatch.unlock_shared();
+        while (!((NodeHeader*) node)->isLeaf) {
+            unsigned int i = KeySearch::countLessOrEqual(getKeys(node), *(unsigned int*) node, points_home);
+            void* child = getNode(getPointers(node)[i]);
+            ((NodeHeader*) child)->isLeaf ? lockNode(child) : getLatch(child).lock_shared();
+            getLatch(node).unlock_shared();
+            node = child;
+        }
+        if (isSafeForInsert(node, points_home)) {
+            insertIntoLeaf(node, points_home, record);
+            unlockNode(node);
+            return;
+        }
+        unlockNode(node);
+    }
 
-    count++;
-    ofstream dummy;
-    void* nodeToInsertAt = findNode(points_home, root, 0, dummy, true);
-    int numKeys = *(unsigned int*)nodeToInsertAt;
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) nodeToInsertAt ) + 1 );
-    pointerBlockPair* test = static_cast<pointerBlockPair*>(ptrArr);
-    GameData* node = static_cast<GameData*>(test->blockAddress);
-    float* points_homeArr = (float*) (ptrArr + maxKeys + 1);
-
-    float increment = 0.0000001;
-    int counter = 1;
-    float temp = points_home;
-
-    bool isDuplicate = false;
-
-    // Check if there will be duplicate keys after the new record is inserted
-    for (auto& entry : duplicateCount) {
-        if (entry.keyValue == points_home) {
-            // Value found, increment the count
-            entry.count++;
-            isDuplicate = true;
+    // Latch the path exclusively, releasing the latches above a node that cannot split
+    VersionedLock rootLock(rootLatch, rootVersion);
+    vector<void*> latchedNodes;
+    void* node = root;
+    lockNode(node);
+    latchedNodes.push_back(node);
+    while (true) {
+        if (isSafeForInsert(node, points_home)) {
+            for (size_t j = 0; j + 1 < latchedNodes.size(); j++) {
+                unlockNode(latchedNodes[j]);
+            }
+            latchedNodes.erase(latchedNodes.begin(), latchedNodes.end() - 1);
+            if (rootLock.isLocked) {
+                rootLock.unlock();
+            }
+        }
+        if (((NodeHeader*) node)->isLeaf) {
             break;
         }
+        unsigned int i = KeySearch::countLessOrEqual(getKeys(node), *(unsigned int*) node, points_home);
+        node = getNode(getPointers(node)[i]);
+        lockNode(node);
+        latchedNodes.push_back(node);
     }
 
-    if(!isDuplicate){
-        duplicateCounter newEntry;
-        newEntry.keyValue = points_home;
-        newEntry.count = 1;
-        duplicateCount.push_back(newEntry);
+    insertIntoLeaf(node, points_home, record);
+    for (void* latchedNode : latchedNodes) {
+        unlockNode(latchedNode);
     }
+}
 
-
-    for (int i = 0; i <= numKeys -1 ; i++) {
-
-        if (temp == points_homeArr[i]){
-            for (auto& entry : duplicateCount) {
-                if (entry.keyValue == temp) {
-                    // Value found, increment the count
-                    counter = entry.count;
-                }
-            }
-            temp = points_home + (increment * counter);
-        }
+// A leaf that is not full, or already holds the key, takes the record without splitting, and a non-leaf node that is not full can take the key of a split child
+// With aggregates, an insert also updates the aggregates of every ancestor, so no node is safe
+/**
+ * @brief Checks whether inserting a key into a node cannot make it split.
+ * @param node The node.
+ * @param points_home The key value being inserted.
+ * @return True if the node cannot split.
+ */
+bool BPlusTree::isSafeForInsert(void* node, float points_home) {
+    if (hasAggregates) {
+        return false;
     }
+    unsigned int numKeys = *(unsigned int*) node;
+    if (numKeys < maxKeys) {
+        return true;
+    }
+    if (!((NodeHeader*) node)->isLeaf) {
+        return false;
+    }
+    float* pointsHomeArr = getKeys(node);
+    unsigned int i = KeySearch::countLess(pointsHomeArr, numKeys, points_home);
+    return i < numKeys && pointsHomeArr[i] == points_home;
+}
 
-
-    points_home = temp;
-    // CASE 2: Unique key, but number of keys after insertion to node exceeds max number of keys allowed
-    if (numKeys == maxKeys){
-        splitLeafNode(points_home, record, nodeToInsertAt, ptrArr, points_homeArr);
-        return;
+// Adds a record to the list of records sharing the key of a leaf entry
+// The first duplicate moves the existing record pointer into a new overflow node, and the leaf entry then points to that overflow node
+// Overflow nodes are chained through their last pointer, and a new overflow node is added to the front of the chain once the first one is full
+/**
+ * @brief Adds a record with a duplicate key to the overflow nodes of a leaf entry.
+ * @param keyEntry The leaf entry holding the duplicated key.
+ * @param record The pointer-block pair representing the record.
+ */
+void BPlusTree::insertDuplicate(pointerBlockPair* keyEntry, pointerBlockPair record) {
+
+    // Key only points to a single record so far, move it into a new overflow node
+    if (keyEntry->recordID != -1) {
+        void* overflowNode = getNewNode(true, true);
+        pointerBlockPair* ptrArr = getPointers(overflowNode);
+        ptrArr[0] = *keyEntry;
+        *(unsigned int*)overflowNode = 1;
+        *keyEntry = {getNodeId(overflowNode), -1};
     }
 
-    // CASE 3: Unique key, and node has sufficient space to hold new key
-    int i;
-    for (i = 0; i <= numKeys-1; i++) { //Find position within node to insert key
-        if (points_home < points_homeArr[i]){
-            for (int j = numKeys; j > i; j--) { // Shift current keys back to accomondate new key
-                points_homeArr[j] = points_homeArr[j-1];
-                ptrArr[j] = ptrArr[j-1];
-            }
-            break;
-        }
+    // First overflow node is full, chain a new overflow node in front of it
+    void* overflowNode = getNode(*keyEntry);
+    if (*(unsigned int*)overflowNode == maxKeys) {
+        void* newOverflowNode = getNewNode(true, true);
+        pointerBlockPair* ptrArrNew = getPointers(newOverflowNode);
+        ptrArrNew[maxKeys].blockId = getNodeId(overflowNode);
+        keyEntry->blockId = getNodeId(newOverflowNode);
+        overflowNode = newOverflowNode;
     }
-    points_homeArr[i] = points_home;
-    ptrArr[i] = record;
-    cout << fixed << setprecision(7);
-    (*(unsigned int*)nodeToInsertAt)++; //Increment number of records in leaf node
+
+    pointerBlockPair* ptrArr = getPointers(overflowNode);
+    ptrArr[*(unsigned int*)overflowNode] = record;
+    (*(unsigned int*)overflowNode)++;
 }
 
 
@@ -328,30 +1357,30 @@ void BPlusTree::insertRecord(float points_home, pointerBlockPair record) {
  * @param output The output file stream for logging.
  * @return A pointer to the node containing the key to delete.
  */
-void* BPlusTree::findKeyToDelete(float pointsHome, void* rootNode, ofstream &output) {
-    void* currNode = findNode(pointsHome, root, 0, output, false);
+void* BPlusTree::findKeyToDelete(float pointsHome, void* /*rootNode*/, ofstream &/*output*/) {
+    void* currNode = findNode(pointsHome);
 
     // Traverse to the node containing the key
     unsigned int numkeys = *(unsigned int *)currNode;
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) currNode ) + 1 );
-    float* numVotesArr = (float*) (ptrArr + maxKeys + 1);
-    int i = 0;
+    pointerBlockPair* ptrArr = getPointers(currNode);
+    float* numVotesArr = getKeys(currNode);
+    int i = KeySearch::countLess(numVotesArr, numkeys, pointsHome); // skip the keys smaller than pointsHome
 
     while (i < numkeys && numVotesArr[i] <= pointsHome) {
         if (numVotesArr[i] == pointsHome) { // Check if key is greater than starting key
-            currNode = ptrArr[maxKeys].blockAddress;
+            currNode = getNode(ptrArr[maxKeys]);
             break;
         }
         if (i == numkeys - 1) {
-            if (ptrArr[maxKeys].blockAddress == nullptr) {
+            if (ptrArr[maxKeys].blockId == -1) {
                 // If there's no next leaf node, break out of the loop
                 break;
             }
-            currNode = ptrArr[maxKeys].blockAddress; // Traverse to the next leaf node
+            currNode = getNode(ptrArr[maxKeys]); // Traverse to the next leaf node
 
             // Reset the search to the start of the next leaf node
-            ptrArr = (pointerBlockPair*) (((NodeHeader*) currNode ) + 1 );
-            numVotesArr = (float*) (ptrArr + maxKeys + 1);
+            ptrArr = getPointers(currNode);
+            numVotesArr = getKeys(currNode);
             numkeys = *(unsigned int *)currNode;
             i = 0;
             continue;
@@ -363,161 +1392,211 @@ void* BPlusTree::findKeyToDelete(float pointsHome, void* rootNode, ofstream &out
 }
 
 // Function to delete a key
+// A leaf loses the key together with its record or overflow nodes, a non-leaf node loses the key and the child pointer right of it
+// A node left with too few keys borrows a key from a sibling, or is merged with it if neither sibling can spare one
+// Separators in the ancestors are left as they are, since they still divide the keys of their subtrees correctly
 /**
- * @brief Deletes a record with a specific key value from the B+ tree.
- * @param pointsHome The key value of the record to delete.
- * @param nodeToDeleteFrom The node to delete the record from.
+ * @brief Deletes a key from a node of the B+ tree, rebalancing the tree if the node underflows.
+ * @param pointsHome The key value to delete.
+ * @param nodeToDeleteFrom The node to delete the key from, which is the leaf holding the key for a record.
  */
 void BPlusTree::deleteKey(float pointsHome, void* nodeToDeleteFrom) {
     unsigned int* numKeys = (unsigned int*)nodeToDeleteFrom;
     NodeHeader header = *(NodeHeader*) nodeToDeleteFrom;
-    pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) nodeToDeleteFrom ) + 1 );
-    float* pointsHomeArr = (float*) (ptrArr + maxKeys + 1);
+    pointerBlockPair* ptrArr = getPointers(nodeToDeleteFrom);
+    float* pointsHomeArr = getKeys(nodeToDeleteFrom);
 
     // Search for the key in the node to delete from
-    bool keyExists = false;
-    int i;
-    for (i = 0; i < *numKeys; i++) {
-        if (pointsHomeArr[i] == pointsHome) {
-            keyExists = true;
-            break;
-        }
-    }
+    int i = KeySearch::countLess(pointsHomeArr, *numKeys, pointsHome);
+    bool keyExists = i < *numKeys && pointsHomeArr[i] == pointsHome;
 
-    // If the key does not exist, handle the case appropriately
+    // If the key does not exist, there is nothing to delete
     if (!keyExists) {
-        // You can log an error or handle this case based on your requirements
         return;
     }
 
-    // Declaration of minimum number of keys allowed depending on leaf or non-leaf node
-    unsigned int minKeys = 0;
-    if (header.isLeaf) {
-        minKeys = (maxKeys + 1) / 2;
-    } else {
-        minKeys = maxKeys / 2;
-    }
-
     // Perform deletion of any overflow nodes first, if they exist
-    if (ptrArr[i].recordID >= pointsHome && ptrArr[i].recordID < pointsHome + 0.001) {
+    if (header.isLeaf && ptrArr[i].recordID == -1) {
         // RecordID of -1 indicates that there is an overflow node
-        void* tempNode = ptrArr[i].blockAddress;
-        pointerBlockPair* ptrArr;
-        void* nextOverflow;
+        void* tempNode = getNode(ptrArr[i]);
         while (tempNode != nullptr) {
             numOverflowNodesDeleted++;
-            ptrArr = (pointerBlockPair*) (((NodeHeader*) tempNode ) + 1 );
-            nextOverflow = ptrArr[maxKeys].blockAddress; // Hold pointer nextOverflow before we free the current overflow block
-            free(tempNode);
+            void* nextOverflow = getNode((getPointers(tempNode))[maxKeys]); // Hold pointer nextOverflow before we free the current overflow block
+            freeNode(tempNode);
             numOverflowNodes--;
             tempNode = nextOverflow; // Proceed to delete and free the next overflowNode
         }
     }
 
     // Perform deletion of the key from the node
+    EntryAggregate* aggregateArr = hasAggregates ? getAggregates(nodeToDeleteFrom) : nullptr;
+    shiftElementsForward(pointsHomeArr, ptrArr, i, header.isLeaf, aggregateArr);
     (*numKeys)--;
-    if (i != maxKeys - 1) { // If element to remove is not the last element
-        shiftElementsForward(pointsHomeArr, ptrArr, i, header.isLeaf);
-    }
-
-    void* parentNode = ((NodeHeader*)nodeToDeleteFrom)->pointerToParent.blockAddress;
-    int numKeysInParent = *(unsigned int*) parentNode;
-    pointerBlockPair* ptrArrParent = (pointerBlockPair*) (((NodeHeader*) parentNode ) + 1 );
-    float* pointsHomeArrParent = (float*) (ptrArrParent + maxKeys + 1);
-
-    // Check if the key to be deleted appears in any of its ancestors and find the node it is in
-    // This will only occur if the key we are deleting is the smallest key in its index node
-    if (i == 0) {
-        void* recursiveParent;
-        // If the number of keys remaining is less than the minimum keys allowed, borrowing/merging needs to be performed
-        if (*numKeys < minKeys) {
-            for (int ourPosInParent = 0; ourPosInParent <= numKeysInParent; ourPosInParent++) {
-                // Find number of keys in the sibling node and check if number - 1 is less than minkeys
-                if (ptrArrParent[ourPosInParent].blockAddress == nodeToDeleteFrom) {
-                    // Find our position in parentNode so we can identify our siblings
-                    void* sibling = nullptr;
-                    unsigned int* siblingNumKeys;
-                    bool borrowFromLeft;
-                    NodeHeader siblingHeader;
-
-                    // If the left sibling exists, check if a key can be borrowed from it
-                    if (ourPosInParent != 0) {
-                        sibling = ptrArrParent[ourPosInParent - 1].blockAddress;
-                        siblingNumKeys = (unsigned int*) sibling;
-                        siblingHeader = *(NodeHeader*) sibling;
-                        if (*siblingNumKeys - 1 < minKeys) {
-                            // Not possible to borrow from the left sibling
-                            sibling = nullptr;
-                        } else {
-                            // Borrow from the left sibling; don't bother checking with the right sibling
-                            borrowFromLeft = true;
-                        }
-                    }
 
-                    // If key cannot be borrowed from the left sibling or the left sibling does not exist, check the right sibling
-                    if (sibling == nullptr && ourPosInParent != numKeysInParent) {
-                        sibling = ptrArrParent[ourPosInParent + 1].blockAddress;
-                        siblingNumKeys = (unsigned int*) sibling;
-                        siblingHeader = *(NodeHeader*) sibling;
-                        if (*siblingNumKeys - 1 < minKeys) {
-                            // Not possible to borrow from the right sibling
-                            sibling = nullptr;
-                        } else {
-                            // Borrow from the right sibling
-                            borrowFromLeft = false;
-                        }
-                    }
+    rebalanceNode(nodeToDeleteFrom);
+}
 
-                    // Perform borrowing if there exists a sibling that allows for borrowing
-                    if (sibling != nullptr) {
-                        pointerBlockPair* ptrArrSibling = (pointerBlockPair*) (((NodeHeader*) sibling ) + 1 );
-                        float* pointsHomeArrSibling = (float*) (ptrArrSibling + maxKeys + 1);
-                        if (borrowFromLeft) {
-                            // Borrow the last key from the left sibling
-                            // Shift all elements in nodeToDeleteFrom to the right to make space for the new key
-                            shiftElementsBack(pointsHomeArr, ptrArr, 0, siblingHeader.isLeaf);
-                            pointsHomeArr[0] = pointsHomeArrSibling[(*siblingNumKeys) - 1]; // Borrowing of key
-                            ptrArr[0] = ptrArrSibling[(*siblingNumKeys) - 1];
-                            (*siblingNumKeys)--;
-                            (*numKeys)++;
-
-                            // Update the index in the parent node that leads to this node
-                            pointsHomeArrParent[ourPosInParent - 1] = pointsHomeArr[0];
-                        } else {
-                            // Borrow the first key from the right sibling
-                            pointsHomeArr[*numKeys] = pointsHomeArrSibling[0]; // Borrowing of key
-                            ptrArr[*numKeys] = ptrArrSibling[0];
-                            (*numKeys)++;
-
-                            // Shift all elements in the right sibling to fill up space due to the key borrowed
-                            shiftElementsForward(pointsHomeArrSibling, ptrArrSibling, 0, siblingHeader.isLeaf);
-
-                            (*siblingNumKeys)--;
-
-                            // Update the index in the parent node that leads to the right sibling
-                            pointsHomeArrParent[ourPosInParent] = pointsHomeArrSibling[0];
-                        }
-                    } else {
-                        if (ourPosInParent != 0) { // If not the leftmost node, merge with the left sibling
-                            mergeNodes(ptrArrParent[ourPosInParent - 1].blockAddress, nodeToDeleteFrom);
-                        } else { // If the leftmost node, merge with the right sibling
-                            mergeNodes(nodeToDeleteFrom, ptrArrParent[1].blockAddress);
-                        }
-                    }
+// Brings a node that may hold too few keys back to the minimum number of keys
+// Entries are borrowed one at a time from the left sibling and then the right sibling, as long as they can spare one
+// If the node is still short of keys, it is merged with a sibling, which removes a separator from the parent and may rebalance it in turn
+/**
+ * @brief Rebalances a node after keys have been removed from it.
+ * @param node The node to rebalance.
+ */
+void BPlusTree::rebalanceNode(void* node) {
+    NodeHeader header = *(NodeHeader*) node;
+    unsigned int* numKeys = (unsigned int*) node;
+
+    // The root has no minimum number of keys, but a non-leaf root left with a single child is replaced by that child
+    if (node == root) {
+        while (!((NodeHeader*) root)->isLeaf && *(unsigned int*) root == 0) {
+            void* oldRoot = root;
+            root = getNode((getPointers(oldRoot))[0]);
+            ((NodeHeader*) root)->pointerToParent.blockId = -1;
+            freeNode(oldRoot);
+            numNodes--;
+            numNodesDeleted++;
+            height--;
+        }
+        refreshAggregates(root);
+        return;
+    }
 
-                    break;
-                }
-            }
+    // Declaration of minimum number of keys allowed depending on leaf or non-leaf node
+    unsigned int minKeys = header.isLeaf ? (maxKeys + 1) / 2 : maxKeys / 2;
+    if (*numKeys >= minKeys) {
+        refreshAggregates(node);
+        return;
+    }
+
+    // Find our position in the parent node so we can identify our siblings
+    void* parentNode = getNode(header.pointerToParent);
+    unsigned int numKeysInParent = *(unsigned int*) parentNode;
+    pointerBlockPair* ptrArrParent = getPointers(parentNode);
+    int nodeId = getNodeId(node);
+    unsigned int ourPosInParent = 0;
+    while (ourPosInParent < numKeysInParent && ptrArrParent[ourPosInParent].blockId != nodeId) {
+        ourPosInParent++;
+    }
+
+    // A node that is the only child of its parent has no sibling until the parent itself is rebalanced, which only happens after a range deletion
+    if (numKeysInParent == 0) {
+        rebalanceNode(parentNode);
+        rebalanceNode(node);
+        return;
+    }
+
+    void* leftSibling = ourPosInParent > 0 ? getNode(ptrArrParent[ourPosInParent - 1]) : nullptr;
+    void* rightSibling = ourPosInParent < numKeysInParent ? getNode(ptrArrParent[ourPosInParent + 1]) : nullptr;
+
+    bool borrowed = false;
+    while (leftSibling != nullptr && *numKeys < minKeys && *(unsigned int*) leftSibling > minKeys) {
+        borrowFromLeft(node, leftSibling, parentNode, ourPosInParent);
+        borrowed = true;
+    }
+    if (borrowed) {
+        refreshAggregates(leftSibling);
+    }
+    borrowed = false;
+    while (rightSibling != nullptr && *numKeys < minKeys && *(unsigned int*) rightSibling > minKeys) {
+        borrowFromRight(node, rightSibling, parentNode, ourPosInParent);
+        borrowed = true;
+    }
+    if (borrowed) {
+        refreshAggregates(rightSibling);
+    }
+
+    if (*numKeys >= minKeys) {
+        if (hasAggregates && !header.isLeaf) {
+            recomputeAggregates(node); // children have moved between the nodes
         }
+        refreshAggregates(node);
+    } else if (leftSibling != nullptr) { // If not the leftmost node, merge with the left sibling
+        mergeNodes(leftSibling, node);
+    } else { // If the leftmost node, merge with the right sibling
+        mergeNodes(node, rightSibling);
+    }
+}
 
-        // If deleting the root node and the current node becomes the new root node
-        if (nodeToDeleteFrom == root && *numKeys == 1) {
-            free(root);
-            numNodes--;
-            numNodesDeleted++;
-            root = ptrArr[0].blockAddress;
+/**
+ * @brief Moves the last entry of the left sibling of a node into the node, updating the separator between them.
+ * @param node The node receiving the entry.
+ * @param leftSibling The left sibling of the node.
+ * @param parentNode The parent of both nodes.
+ * @param posInParent The position of the node among the children of its parent.
+ */
+void BPlusTree::borrowFromLeft(void* node, void* leftSibling, void* parentNode, unsigned int posInParent) {
+    unsigned int* numKeys = (unsigned int*) node;
+    pointerBlockPair* ptrArr = getPointers(node);
+    float* pointsHomeArr = getKeys(node);
+    EntryAggregate* aggregateArr = hasAggregates ? getAggregates(node) : nullptr;
+    unsigned int* siblingNumKeys = (unsigned int*) leftSibling;
+    pointerBlockPair* ptrArrSibling = getPointers(leftSibling);
+    float* pointsHomeArrSibling = getKeys(leftSibling);
+    EntryAggregate* aggregateArrSibling = hasAggregates ? getAggregates(leftSibling) : nullptr;
+    float* pointsHomeArrParent = getKeys(parentNode);
+
+    if (((NodeHeader*) node)->isLeaf) {
+        shiftElementsBack(pointsHomeArr, ptrArr, 0, true, aggregateArr);
+        pointsHomeArr[0] = pointsHomeArrSibling[*siblingNumKeys - 1];
+        ptrArr[0] = ptrArrSibling[*siblingNumKeys - 1];
+        if (hasAggregates) {
+            aggregateArr[0] = aggregateArrSibling[*siblingNumKeys - 1];
+        }
+        pointsHomeArrParent[posInParent - 1] = pointsHomeArr[0]; // Update the separator that leads to this node
+    } else {
+        // Rotate the last child of the left sibling through the separator in the parent
+        shiftElementsBack(pointsHomeArr, ptrArr, 0, false, aggregateArr);
+        pointsHomeArr[0] = pointsHomeArrParent[posInParent - 1];
+        ptrArr[1] = ptrArr[0];
+        ptrArr[0] = ptrArrSibling[*siblingNumKeys];
+        ((NodeHeader*) getNode(ptrArr[0]))->pointerToParent.blockId = getNodeId(node);
+        pointsHomeArrParent[posInParent - 1] = pointsHomeArrSibling[*siblingNumKeys - 1];
+    }
+    (*siblingNumKeys)--;
+    (*numKeys)++;
+}
+
+/**
+ * @brief Moves the first entry of the right sibling of a node into the node, updating the separator between them.
+ * @param node The node receiving the entry.
+ * @param rightSibling The right sibling of the node.
+ * @param parentNode The parent of both nodes.
+ * @param posInParent The position of the node among the children of its parent.
+ */
+void BPlusTree::borrowFromRight(void* node, void* rightSibling, void* parentNode, unsigned int posInParent) {
+    unsigned int* numKeys = (unsigned int*) node;
+    pointerBlockPair* ptrArr = getPointers(node);
+    float* pointsHomeArr = getKeys(node);
+    EntryAggregate* aggregateArr = hasAggregates ? getAggregates(node) : nullptr;
+    unsigned int* siblingNumKeys = (unsigned int*) rightSibling;
+    pointerBlockPair* ptrArrSibling = getPointers(rightSibling);
+    float* pointsHomeArrSibling = getKeys(rightSibling);
+    EntryAggregate* aggregateArrSibling = hasAggregates ? getAggregates(rightSibling) : nullptr;
+    float* pointsHomeArrParent = getKeys(parentNode);
+
+    if (((NodeHeader*) node)->isLeaf) {
+        pointsHomeArr[*numKeys] = pointsHomeArrSibling[0];
+        ptrArr[*numKeys] = ptrArrSibling[0];
+        if (hasAggregates) {
+            aggregateArr[*numKeys] = aggregateArrSibling[0];
+        }
+        shiftElementsForward(pointsHomeArrSibling, ptrArrSibling, 0, true, aggregateArrSibling);
+        pointsHomeArrParent[posInParent] = pointsHomeArrSibling[0]; // Update the separator that leads to the right sibling
+    } else {
+        // Rotate the first child of the right sibling through the separator in the parent
+        pointsHomeArr[*numKeys] = pointsHomeArrParent[posInParent];
+        ptrArr[*numKeys + 1] = ptrArrSibling[0];
+        ((NodeHeader*) getNode(ptrArr[*numKeys + 1]))->pointerToParent.blockId = getNodeId(node);
+        pointsHomeArrParent[posInParent] = pointsHomeArrSibling[0];
+        ptrArrSibling[0] = ptrArrSibling[1];
+        if (hasAggregates) {
+            aggregateArrSibling[0] = aggregateArrSibling[1];
         }
+        shiftElementsForward(pointsHomeArrSibling, ptrArrSibling, 0, false, aggregateArrSibling);
     }
+    (*siblingNumKeys)--;
+    (*numKeys)++;
 }
 
 
@@ -526,46 +1605,70 @@ void BPlusTree::deleteKey(float pointsHome, void* nodeToDeleteFrom) {
 // Merging occurs by keeping the left node, and deleting the right node
 // Is called by deleteKey() if deletion results in nodes with insufficient keys
 /**
- * @brief Merges two nodes (either leaf or non-leaf) into one node.
+ * @brief Merges two sibling nodes (either leaf or non-leaf) into the left node, and removes the separator between them from their parent.
  * @param leftNode The left node to be merged.
  * @param rightNode The right node to be merged.
  */
 void BPlusTree::mergeNodes(void* leftNode, void* rightNode) {
 
-    pointerBlockPair* ptrArrL = (pointerBlockPair*) (((NodeHeader*) leftNode ) + 1 );
-    float* pointsHomeArrL = (float*) (ptrArrL + maxKeys + 1);
+    pointerBlockPair* ptrArrL = getPointers(leftNode);
+    float* pointsHomeArrL = getKeys(leftNode);
 
-    pointerBlockPair* ptrArrR = (pointerBlockPair*) (((NodeHeader*) rightNode ) + 1 );
-    float* pointsHomeArrR = (float*) (ptrArrR + maxKeys + 1);
+    pointerBlockPair* ptrArrR = getPointers(rightNode);
+    float* pointsHomeArrR = getKeys(rightNode);
 
-    float smallestRight = pointsHomeArrR[0];
     unsigned int* numKeysL = (unsigned int*)leftNode;
     unsigned int* numKeysR = (unsigned int*)rightNode;
 
-    // For each item in the right node, append to the left node
-    for (int i=0; i<*numKeysR; i++) {
-        pointsHomeArrL[*numKeysL+i] = pointsHomeArrR[i];
-        ptrArrL[*numKeysL+i] = ptrArrR[i];
+    // Retrieve parent node and the separator between the two nodes
+    void* parentNode = getNode(((NodeHeader*) leftNode)->pointerToParent);
+    pointerBlockPair* ptrArrParent = getPointers(parentNode);
+    float* pointsHomeArrParent = getKeys(parentNode);
+    int rightId = getNodeId(rightNode);
+    unsigned int rightPosInParent = 1;
+    while (ptrArrParent[rightPosInParent].blockId != rightId) {
+        rightPosInParent++;
     }
-    *numKeysL += *numKeysR;
+    float separator = pointsHomeArrParent[rightPosInParent - 1];
 
-    // For leaf nodes, the original left node should now point to the node pointed to by the original right node
     NodeHeader header = *(NodeHeader*) leftNode;
     if (header.isLeaf) {
+        // For each item in the right node, append to the left node
+        for (unsigned int i = 0; i < *numKeysR; i++) {
+            pointsHomeArrL[*numKeysL+i] = pointsHomeArrR[i];
+            ptrArrL[*numKeysL+i] = ptrArrR[i];
+            if (hasAggregates) {
+                getAggregates(leftNode)[*numKeysL+i] = getAggregates(rightNode)[i];
+            }
+        }
+        *numKeysL += *numKeysR;
+
+        // The original left node should now point to the node pointed to by the original right node
         ptrArrL[maxKeys] = ptrArrR[maxKeys];
+    } else {
+        // The separator comes down between the keys of the two nodes, and the children of the right node move to the left node
+        pointsHomeArrL[*numKeysL] = separator;
+        for (unsigned int i = 0; i < *numKeysR; i++) {
+            pointsHomeArrL[*numKeysL+1+i] = pointsHomeArrR[i];
+        }
+        int leftId = getNodeId(leftNode);
+        for (unsigned int i = 0; i <= *numKeysR; i++) {
+            ptrArrL[*numKeysL+1+i] = ptrArrR[i];
+            ((NodeHeader*) getNode(ptrArrR[i]))->pointerToParent.blockId = leftId;
+        }
+        *numKeysL += *numKeysR + 1;
+        if (hasAggregates) {
+            recomputeAggregates(leftNode);
+        }
     }
 
-    // Retrieve parent node for deletion of key
-    void* parentNode = ((NodeHeader*)leftNode)->pointerToParent.blockAddress;
-
-    free(rightNode);
+    freeNode(rightNode);
     numNodes--;
     numNodesDeleted++;
 
     //Parent node that points to the original left and right node will have one less key
-    //Key to be removed from parent node is always first key of original right node
-    //Smallest right is passed in with the parent node
-    deleteKey(smallestRight, parentNode);
+    //Key to be removed from parent node is the separator, together with the pointer to the original right node
+    deleteKey(separator, parentNode);
 }
 
 
@@ -588,9 +1691,12 @@ void BPlusTree::splitLeafNode(float points_home, pointerBlockPair record, void*
 
     list<pointerBlockPair> tempPtrList;
     list<float> tempPointHomeList;
+    list<EntryAggregate> tempAggregateList; // only filled if the nodes hold aggregates
+    EntryAggregate* aggregateArr = hasAggregates ? getAggregates(leftNode) : nullptr;
+    EntryAggregate newAggregate = {1, hasAggregates ? payloadReader(record) : 0};
     unsigned int numLeftKeys = ceil((maxKeys+1)/2.0);
     unsigned int numRightKeys = floor((maxKeys+1)/2.0);
-    void* parentNode = ((NodeHeader*)nodeToSplit)->pointerToParent.blockAddress;
+    void* parentNode = getNode(((NodeHeader*) nodeToSplit)->pointerToParent);
 
     // Copy existing keys into a temp list, and add in new key in correct position
     bool newKeyInserted = false;
@@ -599,25 +1705,33 @@ void BPlusTree::splitLeafNode(float points_home, pointerBlockPair record, void*
         if (!newKeyInserted && points_home < ptsHomeArr[i]){
             tempPointHomeList.push_back(points_home);
             tempPtrList.push_back(record);
+            tempAggregateList.push_back(newAggregate);
             newKeyInserted = true;
         }
         tempPointHomeList.push_back(ptsHomeArr[i]);
         tempPtrList.push_back(ptrArr[i]);
+        tempAggregateList.push_back(hasAggregates ? aggregateArr[i] : newAggregate);
     }
     if (points_home > ptsHomeArr[maxKeys-1]){ // Runs when new numNodes is bigger than all keys
         tempPointHomeList.push_back(points_home);
         tempPtrList.push_back(record);
+        tempAggregateList.push_back(newAggregate);
     }
 
-    pointerBlockPair* ptrArrR = (pointerBlockPair*) (((NodeHeader*) rightNode ) + 1 );
-    float* pointsHomeArrR = (float*) (ptrArrR + maxKeys + 1);
+    pointerBlockPair* ptrArrR = getPointers(rightNode);
+    float* pointsHomeArrR = getKeys(rightNode);
+    EntryAggregate* aggregateArrR = hasAggregates ? getAggregates(rightNode) : nullptr;
 
     // Filling in keys for new left node
     for (int i = 0; i < numLeftKeys; i++) {
         ptsHomeArr[i] = tempPointHomeList.front();
         ptrArr[i] = tempPtrList.front();
+        if (hasAggregates) {
+            aggregateArr[i] = tempAggregateList.front();
+        }
         tempPointHomeList.pop_front();
         tempPtrList.pop_front();
+        tempAggregateList.pop_front();
     }
     *((unsigned int*) leftNode) = numLeftKeys;
 
@@ -625,16 +1739,20 @@ void BPlusTree::splitLeafNode(float points_home, pointerBlockPair record, void*
     for (int i = 0; i < numRightKeys; i ++) {
         pointsHomeArrR[i] = tempPointHomeList.front();
         ptrArrR[i] = tempPtrList.front();
+        if (hasAggregates) {
+            aggregateArrR[i] = tempAggregateList.front();
+        }
         tempPointHomeList.pop_front();
         tempPtrList.pop_front();
+        tempAggregateList.pop_front();
     }
     *((unsigned int*) rightNode) = numRightKeys;
 
     // Linking of leaf nodes
     // Original right node should now point to the node pointed to by the original left node
     // Left node should now point to the newly created right node
-    ptrArrR[maxKeys].blockAddress = ptrArr[maxKeys].blockAddress;
-    ptrArr[maxKeys].blockAddress = rightNode;
+    ptrArrR[maxKeys].blockId = ptrArr[maxKeys].blockId;
+    ptrArr[maxKeys].blockId = getNodeId(rightNode);
 
     updateParentNodeAfterSplit(parentNode, rightNode, pointsHomeArrR[0]);
 
@@ -663,7 +1781,7 @@ void BPlusTree::splitNonLeafNode(float points_home, pointerBlockPair record, voi
     list<float> tempPointsHomeList;
     unsigned int numLeftKeys = ceil(maxKeys/2.0);
     unsigned int numRightKeys = floor(maxKeys/2.0);
-    void* parentNode = ((NodeHeader*)nodeToSplit)->pointerToParent.blockAddress;
+    void* parentNode = getNode(((NodeHeader*) nodeToSplit)->pointerToParent);
 
     // Copy existing keys into a temp list
     for (int i = 0; i < maxKeys; i++) {
@@ -691,21 +1809,21 @@ void BPlusTree::splitNonLeafNode(float points_home, pointerBlockPair record, voi
         pointsHomeItr++;
     }
 
-    pointerBlockPair* ptrArrR = (pointerBlockPair*) (((NodeHeader*) rightNode ) + 1 );
-    float* numVotesArrR = (float*) (ptrArrR + maxKeys + 1);
+    pointerBlockPair* ptrArrR = getPointers(rightNode);
+    float* numVotesArrR = getKeys(rightNode);
 
     // Filling in keys for new left node
     int i;
     for (i = 0; i < numLeftKeys; i++) {
         ptsHomeArr[i] = tempPointsHomeList.front();
         ptrArr[i] = tempPtrList.front();
-        ((NodeHeader*) ptrArr[i].blockAddress)->pointerToParent.blockAddress = leftNode; // update all children to point to leftNode as new parent
+        ((NodeHeader*) getNode(ptrArr[i]))->pointerToParent.blockId = getNodeId(leftNode); // update all children to point to leftNode as new parent
         tempPointsHomeList.pop_front();
         tempPtrList.pop_front();
     }
     ptrArr[i] = tempPtrList.front(); // node needs 1 more ptr than key
     tempPtrList.pop_front(); //Pop the pointer after assigning it
-    ((NodeHeader*) ptrArr[numLeftKeys].blockAddress)->pointerToParent.blockAddress = leftNode; // update last children to point to leftNode as new parent
+    ((NodeHeader*) getNode(ptrArr[numLeftKeys]))->pointerToParent.blockId = getNodeId(leftNode); // update last children to point to leftNode as new parent
     *((unsigned int*) leftNode) = numLeftKeys; //Update the number of keys for this left node
 
 
@@ -718,15 +1836,21 @@ void BPlusTree::splitNonLeafNode(float points_home, pointerBlockPair record, voi
     for (i = 0; i < numRightKeys; i++) {
         numVotesArrR[i] = tempPointsHomeList.front();
         ptrArrR[i] = tempPtrList.front();
-        ((NodeHeader*) ptrArrR[i].blockAddress)->pointerToParent.blockAddress = rightNode; // update all children of right node to point to itself as new parent
+        ((NodeHeader*) getNode(ptrArrR[i]))->pointerToParent.blockId = getNodeId(rightNode); // update all children of right node to point to itself as new parent
         tempPointsHomeList.pop_front();
         tempPtrList.pop_front();
     }
     ptrArrR[numRightKeys] = tempPtrList.front(); // For non-leaf nodes, n keys requires (n+1) pointers, pop one more pointer
     tempPtrList.pop_front();
-    ((NodeHeader*) ptrArrR[numRightKeys].blockAddress)->pointerToParent.blockAddress = rightNode; // update last children to point to itself as new parent
+    ((NodeHeader*) getNode(ptrArrR[numRightKeys]))->pointerToParent.blockId = getNodeId(rightNode); // update last children to point to itself as new parent
     *((unsigned int*) rightNode) = numRightKeys; // Update the number of keys for this right node
 
+    // Children have moved between the two nodes, so their aggregates are recomputed before the parent sums them up
+    if (hasAggregates) {
+        recomputeAggregates(leftNode);
+        recomputeAggregates(rightNode);
+    }
+
     updateParentNodeAfterSplit(parentNode, rightNode, newParentKey);
 
     return;
@@ -748,56 +1872,219 @@ void BPlusTree::updateParentNodeAfterSplit(void* parentNode, void* rightNode, fl
     if (parentNode == nullptr) {
         void* newRootNode = getNewNode(false, false); // create a parent node (root)
 
-        pointerBlockPair* ptrArrNew = (pointerBlockPair*) (((NodeHeader*) newRootNode ) + 1 );
-        float* pointsHomeArrNew = (float*) (ptrArrNew + maxKeys + 1);
+        pointerBlockPair* ptrArrNew = getPointers(newRootNode);
+        float* pointsHomeArrNew = getKeys(newRootNode);
 
-        ptrArrNew[0].blockAddress = root; // old root node became the left node
-        ptrArrNew[1].blockAddress = rightNode;
+        ptrArrNew[0].blockId = getNodeId(root); // old root node became the left node
+        ptrArrNew[1].blockId = getNodeId(rightNode);
         pointsHomeArrNew[0] = newKey; // only key in new root node is the smallest key of the right subtree
         (*((unsigned int*) newRootNode))++;
 
         // update parent of the new child nodes
-        ((NodeHeader*) root)->pointerToParent.blockAddress = newRootNode; // this is the left node
-        ((NodeHeader*) rightNode)->pointerToParent.blockAddress = newRootNode;
+        ((NodeHeader*) root)->pointerToParent.blockId = getNodeId(newRootNode); // this is the left node
+        ((NodeHeader*) rightNode)->pointerToParent.blockId = getNodeId(newRootNode);
 
         if (((NodeHeader*) root)->isLeaf) { // left node (old root) needs to link to (new) right node
-            pointerBlockPair* ptrArrRoot = (pointerBlockPair*) (((NodeHeader*) root) + 1 );
-            ptrArrRoot[maxKeys].blockAddress = rightNode; // link leaf nodes together
+            pointerBlockPair* ptrArrRoot = getPointers(root);
+            ptrArrRoot[maxKeys].blockId = getNodeId(rightNode); // link leaf nodes together
         }
 
         root = newRootNode; //Reinitialise new root
         height++; //Increment the variable storing the height of B++ tree
+        if (hasAggregates) {
+            recomputeAggregates(newRootNode);
+        }
 
     } else { //there exists a parent node already
         int numKeys = *(unsigned int*) parentNode;
 
         //Initialise ptrArr and numVotesArr to access pointer and key arrays
-        pointerBlockPair* ptrArr = (pointerBlockPair*) (((NodeHeader*) parentNode ) + 1 );
-        float* pointsHomeArr = (float*) (ptrArr + maxKeys + 1);
+        pointerBlockPair* ptrArr = getPointers(parentNode);
+        float* pointsHomeArr = getKeys(parentNode);
 
         //parent node need to be split
         if (numKeys == maxKeys) {
-            pointerBlockPair addrToRightNode = {rightNode, -1};
+            pointerBlockPair addrToRightNode = {getNodeId(rightNode), -1};
             splitNonLeafNode(newKey, addrToRightNode, parentNode, ptrArr, pointsHomeArr);
         } else { // parent node don't need to split
-            int i;
-            for (i = 0; i <= numKeys-1; i++) { //Find position within node to insert key
-                if (newKey < pointsHomeArr[i]){ // replaced smallestKey with newKey
-                    ptrArr[numKeys+1] = ptrArr[numKeys]; //replace the last pointer first
-                    for (int j = numKeys; j > i; j--) { // shift keys back to accomodate new key
-                        pointsHomeArr[j] = pointsHomeArr[j-1];
-                        ptrArr[j] = ptrArr[j-1];
-                    }
-                    break;
+            int i = KeySearch::countLessOrEqual(pointsHomeArr, numKeys, newKey); //Find position within node to insert key
+            if (i < numKeys) {
+                ptrArr[numKeys+1] = ptrArr[numKeys]; //replace the last pointer first
+                for (int j = numKeys; j > i; j--) { // shift keys back to accomodate new key
+                    pointsHomeArr[j] = pointsHomeArr[j-1];
+                    ptrArr[j] = ptrArr[j-1];
                 }
             }
             pointsHomeArr[i] = newKey; //Insert the index value at specified location // replaced smallestKey with newKey
-            ptrArr[i+1].blockAddress = rightNode; //Insert the pointer to the record in the disk at specified location
+            ptrArr[i+1].blockId = getNodeId(rightNode); //Insert the pointer to the record in the disk at specified location
             (*(unsigned int*)parentNode)++; //Increment numRecords
-            ((NodeHeader*) rightNode)->pointerToParent.blockAddress = parentNode; // right node's parent is the same as left node
+            ((NodeHeader*) rightNode)->pointerToParent.blockId = getNodeId(parentNode); // right node's parent is the same as left node
+            if (hasAggregates) {
+                recomputeAggregates(parentNode);
+            }
+        }
+    }
+
+}
+
+
+// Splits {total} entries into consecutive groups of {capacity} entries for bulk loading
+// If the last group ends up below {minSize}, it is merged with or balanced against the group before it
+/**
+ * @brief Computes the node sizes used when packing a level of the B+ tree during bulk loading.
+ * @param total The number of entries to pack.
+ * @param capacity The number of entries to place in each node.
+ * @param minSize The minimum number of entries a node may hold.
+ * @param maxSize The maximum number of entries a node may hold.
+ * @return The number of entries to place in each node, from left to right.
+ */
+static vector<unsigned int> getPackedNodeSizes(size_t total, unsigned int capacity, unsigned int minSize, unsigned int maxSize) {
+    vector<unsigned int> sizes;
+    while (total > 0) {
+        unsigned int size = total < capacity ? total : capacity;
+        sizes.push_back(size);
+        total -= size;
+    }
+
+    size_t last = sizes.size() - 1;
+    if (sizes.size() > 1 && sizes[last] < minSize) {
+        unsigned int combined = sizes[last - 1] + sizes[last];
+        if (combined <= maxSize) { // Both groups fit into a single node
+            sizes.pop_back();
+            sizes[last - 1] = combined;
+        } else { // Share the entries evenly between the last two nodes
+            sizes[last - 1] = combined - combined / 2;
+            sizes[last] = combined / 2;
+        }
+    }
+    return sizes;
+}
+
+// Builds the B+ Tree bottom-up from a batch of (key, record) pairs
+// Leaves are packed from the sorted entries, then each internal level is built over the level below it until one root remains
+// Records with duplicate keys are kept in overflow nodes, in the same way as insertRecord()
+/**
+ * @brief Builds the B+ tree bottom-up from a batch of records.
+ * @param entries The (key, record) pairs to index. The vector is sorted in place.
+ * @param fillFactor The fraction (0, 1] of each node's capacity to fill.
+ */
+void BPlusTree::bulkLoad(vector<pair<float, pointerBlockPair>>& entries, float fillFactor) {
+    VersionedLock treeLock(treeLatch, treeVersion, false);
+    if (isConcurrent) {
+        treeLock.lock();
+    }
+
+    // Bulk loading is only possible into an empty tree, otherwise fall back to individual inserts
+    if (height != 0 || *(unsigned int*)root != 0) {
+        if (isConcurrent) {
+            treeLock.unlock();
+        }
+        for (auto& entry : entries) {
+            insertRecord(entry.first, entry.second);
+        }
+        return;
+    }
+    if (entries.empty()) {
+        return;
+    }
+
+    // Sort once by key, keeping records with the same key in their original order
+    stable_sort(entries.begin(), entries.end(), [](const pair<float, pointerBlockPair>& a, const pair<float, pointerBlockPair>& b) {
+        return a.first < b.first;
+    });
+
+    // Collapse records with the same key into a single leaf entry, moving the duplicates into overflow nodes
+    // The aggregate of each leaf entry covers all the records of its key
+    vector<EntryAggregate> entryAggregates;
+    size_t numUniqueKeys = 0;
+    size_t i = 0;
+    while (i < entries.size()) {
+        pair<float, pointerBlockPair> entry = entries[i];
+        EntryAggregate entryAggregate = {1, hasAggregates ? payloadReader(entry.second) : 0};
+        size_t j = i + 1;
+        while (j < entries.size() && entries[j].first == entry.first) {
+            insertDuplicate(&entry.second, entries[j].second);
+            if (hasAggregates) {
+                entryAggregate.count++;
+                entryAggregate.sum += payloadReader(entries[j].second);
+            }
+            j++;
+        }
+        entries[numUniqueKeys++] = entry;
+        entryAggregates.push_back(entryAggregate);
+        i = j;
+    }
+    entries.resize(numUniqueKeys);
+
+    fillFactor = fillFactor > 1 ? 1 : fillFactor;
+    unsigned int minLeafKeys = (maxKeys + 1) / 2;
+    unsigned int minChildren = maxKeys / 2 + 1;
+    unsigned int leafCapacity = max(minLeafKeys, (unsigned int) ceil(fillFactor * maxKeys));
+    unsigned int nonLeafCapacity = max(minChildren, (unsigned int) ceil(fillFactor * (maxKeys + 1)));
+
+    // Pack the sorted entries into a chain of leaf nodes, reusing the empty root as the first leaf
+    vector<void*> level;
+    vector<float> smallestKeys; // smallest key found in the subtree of each node in the level
+    void* prevLeaf = nullptr;
+    size_t pos = 0;
+    for (unsigned int size : getPackedNodeSizes(entries.size(), leafCapacity, minLeafKeys, maxKeys)) {
+        void* leaf = (prevLeaf == nullptr) ? root : getNewNode(true, false);
+        pointerBlockPair* ptrArr = getPointers(leaf);
+        float* pointsHomeArr = getKeys(leaf);
+
+        for (unsigned int k = 0; k < size; k++) {
+            pointsHomeArr[k] = entries[pos + k].first;
+            ptrArr[k] = entries[pos + k].second;
+            if (hasAggregates) {
+                getAggregates(leaf)[k] = entryAggregates[pos + k];
+            }
+        }
+        *(unsigned int*)leaf = size;
+
+        // Link the previous leaf to this one
+        if (prevLeaf != nullptr) {
+            pointerBlockPair* ptrArrPrev = getPointers(prevLeaf);
+            ptrArrPrev[maxKeys].blockId = getNodeId(leaf);
+        }
+
+        level.push_back(leaf);
+        smallestKeys.push_back(entries[pos].first);
+        prevLeaf = leaf;
+        pos += size;
+    }
+
+    // Build each non-leaf level on top of the previous level until a single root remains
+    while (level.size() > 1) {
+        vector<void*> parentLevel;
+        vector<float> parentSmallestKeys;
+        pos = 0;
+        for (unsigned int size : getPackedNodeSizes(level.size(), nonLeafCapacity, minChildren, maxKeys + 1)) {
+            void* parentNode = getNewNode(false, false);
+            pointerBlockPair* ptrArr = getPointers(parentNode);
+            float* pointsHomeArr = getKeys(parentNode);
+
+            for (unsigned int k = 0; k < size; k++) {
+                ptrArr[k] = {getNodeId(level[pos + k]), -1};
+                if (k > 0) {
+                    pointsHomeArr[k - 1] = smallestKeys[pos + k]; // key is the smallest key of the subtree to its right
+                }
+                ((NodeHeader*) level[pos + k])->pointerToParent.blockId = getNodeId(parentNode);
+            }
+            *(unsigned int*)parentNode = size - 1;
+            if (hasAggregates) {
+                recomputeAggregates(parentNode);
+            }
+
+            parentLevel.push_back(parentNode);
+            parentSmallestKeys.push_back(smallestKeys[pos]);
+            pos += size;
         }
+        level.swap(parentLevel);
+        smallestKeys.swap(parentSmallestKeys);
+        height++;
     }
 
+    root = level.front();
 }
 
 
@@ -810,18 +2097,25 @@ void BPlusTree::updateParentNodeAfterSplit(void* parentNode, void* rightNode, fl
  * @param ptrArr An array of pointer-block pairs.
  * @param start The starting index for shifting.
  * @param isLeaf Indicates whether the elements are in a leaf node.
+ * @param aggregateArr The aggregates of the entries, shifted along with the pointers, or nullptr if there are none.
  */
-void BPlusTree::shiftElementsForward(float* pointsHomeArr, pointerBlockPair* ptrArr, int start, bool isLeaf) {
+void BPlusTree::shiftElementsForward(float* pointsHomeArr, pointerBlockPair* ptrArr, int start, bool isLeaf, EntryAggregate* aggregateArr) {
 
     if (isLeaf) {
         for (int j = start; j < maxKeys-1; j++) { // stop shifting at i=maxKeys-2 since numVotesArr[maxKeys-1] is the last key
             pointsHomeArr[j] = pointsHomeArr[j+1];
             ptrArr[j] = ptrArr[j+1];
+            if (aggregateArr != nullptr) {
+                aggregateArr[j] = aggregateArr[j+1];
+            }
         }
     } else {
         for (int j = start; j < maxKeys-1; j++) {
             pointsHomeArr[j] = pointsHomeArr[j+1];
             ptrArr[j+1] = ptrArr[j+2]; //For non-leaf node, the j-th key correspond to the (j+1)th pointer
+            if (aggregateArr != nullptr) {
+                aggregateArr[j+1] = aggregateArr[j+2];
+            }
         }
     }
 }
@@ -835,18 +2129,25 @@ void BPlusTree::shiftElementsForward(float* pointsHomeArr, pointerBlockPair* ptr
  * @param ptrArr An array of pointer-block pairs.
  * @param end An array of pointer-block pairs.
  * @param isLeaf Indicates whether the elements are in a leaf node.
+ * @param aggregateArr The aggregates of the entries, shifted along with the pointers, or nullptr if there are none.
  */
-void BPlusTree::shiftElementsBack(float* pointsHomeArr, pointerBlockPair* ptrArr, int end, bool isLeaf) {
+void BPlusTree::shiftElementsBack(float* pointsHomeArr, pointerBlockPair* ptrArr, int end, bool isLeaf, EntryAggregate* aggregateArr) {
 
     if (isLeaf) {
         for (int j = maxKeys-1; j > end; j--) {
             pointsHomeArr[j] = pointsHomeArr[j-1];
             ptrArr[j] = ptrArr[j-1];
+            if (aggregateArr != nullptr) {
+                aggregateArr[j] = aggregateArr[j-1];
+            }
         }
     } else {
         for (int j = maxKeys-1; j > end; j--) {
             pointsHomeArr[j] = pointsHomeArr[j-1];
             ptrArr[j+1] = ptrArr[j];
+            if (aggregateArr != nullptr) {
+                aggregateArr[j+1] = aggregateArr[j];
+            }
         }
     }
 }
@@ -883,12 +2184,12 @@ void BPlusTree::printTree(ofstream &outputFile) {
 
         NodeHeader* header = (NodeHeader*)currNode;
         unsigned int numKeys = header->numKeys;
-        pointerBlockPair* ptrArr = (pointerBlockPair*)(((NodeHeader*)currNode) + 1);
+        pointerBlockPair* ptrArr = getPointers(currNode);
 
         // Add child nodes
         if (!(header->isLeaf)) {
             for (unsigned int i = 0; i < numKeys + 1; i++) {
-                queue.push_back(ptrArr[i].blockAddress);
+                queue.push_back(getNode(ptrArr[i]));
             }
         }
     }
@@ -896,82 +2197,240 @@ void BPlusTree::printTree(ofstream &outputFile) {
     outputFile << "\n===================\n";
 }
 
+/**
+ * @brief Gets the root node of the B+ tree.
+ * @return A pointer to the root node.
+ */
+void* BPlusTree::getRoot() {
+    return root;
+}
 
+// Removes every key within a range from the B+ Tree in a single pass
+// Subtrees lying entirely within the range are detached and freed whole, and only the nodes on the paths to the two ends of the range lose some of their entries
+// The leaf before the range is then linked to the leaf after it, and the two boundary paths are rebalanced from the leaves up
 /**
- * @brief Performs a linear scan for records within a specified range of key values.
- * @param pointsHomeStart The starting key value.
- * @param pointsHomeEnd The ending key value.
- * @param output The output file stream to write results to.
+ * @brief Deletes the keys within a range from the B+ tree, and returns the records they pointed to.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @return The pointer-block pairs of the records removed from the index.
  */
-void BPlusTree::linearScan(float pointsHomeStart, float pointsHomeEnd, ofstream &output) {
-    // Record the start time
-    auto startTime = std::chrono::high_resolution_clock::now();
+list<pointerBlockPair> BPlusTree::deleteRange(float pointsHomeStart, float pointsHomeEnd) {
+    VersionedLock treeLock(treeLatch, treeVersion, false);
+    if (isConcurrent) {
+        treeLock.lock();
+    }
 
-    list<pointerBlockPair> results = findRecord(pointsHomeStart, pointsHomeEnd, output);
-    int numDataBlocksAccessed = 0;
+    list<pointerBlockPair> records;
+    if (pointsHomeStart > pointsHomeEnd) {
+        return records;
+    }
 
-    // Iterate through the results in the B+ tree
-    for (const pointerBlockPair& result : results) {
-        // Here, you may need to adapt this part based on your specific B+ tree structure.
-        // Assuming `result.blockAddress` represents a data block, increment the count.
-        numDataBlocksAccessed++;
+    // Find the last leaf holding a key before the range and the first leaf holding a key after it, which stay linked together
+    void* leftLeaf = findNode(pointsHomeStart);
+    float* leftKeys = getKeys(leftLeaf);
+    if (*(unsigned int*) leftLeaf == 0 || leftKeys[0] >= pointsHomeStart) {
+        leftLeaf = findPreviousLeaf(pointsHomeStart);
+    }
+    void* rightLeaf = findNode(pointsHomeEnd);
+    unsigned int numKeysRight = *(unsigned int*) rightLeaf;
+    pointerBlockPair* ptrArrRight = getPointers(rightLeaf);
+    float* rightKeys = getKeys(rightLeaf);
+    if (numKeysRight == 0 || rightKeys[numKeysRight - 1] <= pointsHomeEnd) {
+        rightLeaf = getNode(ptrArrRight[maxKeys]);
+    }
 
-        // You may also perform additional operations on the data block as needed.
-        // For example, you can access data within the block: `result.blockAddress->data`.
+    // Detach the entries within the range, keeping an empty leaf as the root if every entry is removed
+    if (removeRange(root, pointsHomeStart, pointsHomeEnd, false, false, records)) {
+        freeNode(root);
+        numNodes--;
+        numNodesDeleted++;
+        root = getNewNode(true, false);
+        height = 0;
+        return records;
+    }
+    if (leftLeaf != nullptr && leftLeaf != rightLeaf) {
+        (getPointers(leftLeaf))[maxKeys] = {getNodeId(rightLeaf), -1};
     }
 
-    // Record the end time
-    auto endTime = std::chrono::high_resolution_clock::now();
+    // Rebalance the nodes on the paths to both ends of the range, one level at a time from the leaves up
+    for (unsigned int levelsAboveLeaves = 0; levelsAboveLeaves <= height; levelsAboveLeaves++) {
+        for (float boundary : {pointsHomeStart, pointsHomeEnd}) {
+            void* node = root;
+            for (unsigned int level = 0; level + levelsAboveLeaves < height; level++) {
+                pointerBlockPair* ptrArr = getPointers(node);
+                float* pointsHomeArr = getKeys(node);
+                node = getNode(ptrArr[KeySearch::countLessOrEqual(pointsHomeArr, *(unsigned int*) node, boundary)]);
+            }
+            rebalanceNode(node);
+        }
+    }
+    return records;
+}
 
-    // Calculate the elapsed time in microseconds
-    long long elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+// Removes the entries within a range from the subtree of a node, visiting only the children that overlap the range
+// Children lying entirely within the range are freed whole, and the two children holding the ends of the range are handled recursively
+// The bounds of the keys a node may hold are known from the separators above it, so coveredLeft/coveredRight tell whether they fall within the range
+/**
+ * @brief Removes the entries within a range from the subtree of a node.
+ * @param node The root of the subtree.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param coveredLeft Whether the lower bound of the keys of the subtree lies within the range.
+ * @param coveredRight Whether the upper bound of the keys of the subtree lies within the range.
+ * @param records The list the records of the removed entries are appended to.
+ * @return True if the node has been left without any entry, in which case it is freed unless it is the root.
+ */
+bool BPlusTree::removeRange(void* node, float pointsHomeStart, float pointsHomeEnd, bool coveredLeft, bool coveredRight, list<pointerBlockPair>& records) {
+    unsigned int* numKeys = (unsigned int*) node;
+    bool isLeaf = ((NodeHeader*) node)->isLeaf;
+    pointerBlockPair* ptrArr = getPointers(node);
+    float* pointsHomeArr = getKeys(node);
+    EntryAggregate* aggregateArr = hasAggregates ? getAggregates(node) : nullptr;
 
-    if (output.is_open()) {
-        output << "Running time for Brute Force Linear Scan: "<< elapsedTime << " microseconds \n";
-        output << "Total number of data block accessed (during linear scan): " << numDataBlocksAccessed << "\n";
+    if (isLeaf) {
+        // Collect the records of the keys within the range, then close the gap they leave
+        unsigned int first = KeySearch::countLess(pointsHomeArr, *numKeys, pointsHomeStart);
+        unsigned int last = KeySearch::countLessOrEqual(pointsHomeArr, *numKeys, pointsHomeEnd);
+        for (unsigned int i = first; i < last; i++) {
+            collectRecords(ptrArr[i], records, true);
+        }
+        for (unsigned int i = last; i < *numKeys; i++) {
+            pointsHomeArr[i - (last - first)] = pointsHomeArr[i];
+            ptrArr[i - (last - first)] = ptrArr[i];
+            if (hasAggregates) {
+                aggregateArr[i - (last - first)] = aggregateArr[i];
+            }
+        }
+        *numKeys -= last - first;
+    } else {
+        // Only the children from the one holding the start of the range to the one holding its end overlap the range
+        unsigned int first = KeySearch::countLessOrEqual(pointsHomeArr, *numKeys, pointsHomeStart);
+        unsigned int last = KeySearch::countLessOrEqual(pointsHomeArr, *numKeys, pointsHomeEnd);
+        vector<bool> isRemoved(*numKeys + 1, false);
+        for (unsigned int i = first; i <= last; i++) {
+            void* child = getNode(ptrArr[i]);
+            bool childCoveredLeft = i > 0 ? pointsHomeArr[i - 1] >= pointsHomeStart : coveredLeft;
+            bool childCoveredRight = i < *numKeys ? pointsHomeArr[i] <= pointsHomeEnd : coveredRight;
+            if (childCoveredLeft && childCoveredRight) {
+                freeSubtree(child, records);
+                isRemoved[i] = true;
+            } else {
+                isRemoved[i] = removeRange(child, pointsHomeStart, pointsHomeEnd, childCoveredLeft, childCoveredRight, records);
+            }
+        }
+
+        // Keep the remaining children, each after the separator that was left of it
+        unsigned int numChildren = 0;
+        for (unsigned int i = 0; i <= *numKeys; i++) {
+            if (isRemoved[i]) {
+                continue;
+            }
+            if (numChildren > 0) {
+                pointsHomeArr[numChildren - 1] = pointsHomeArr[i - 1];
+            }
+            ptrArr[numChildren] = ptrArr[i];
+            if (hasAggregates) {
+                aggregateArr[numChildren] = aggregateArr[i];
+            }
+            numChildren++;
+        }
+        if (numChildren == 0) {
+            *numKeys = 0;
+            if (node != root) {
+                freeNode(node);
+                numNodes--;
+                numNodesDeleted++;
+            }
+            return true;
+        }
+        *numKeys = numChildren - 1;
+        if (hasAggregates) {
+            recomputeAggregates(node);
+        }
     }
+
+    if (*numKeys == 0 && isLeaf && node != root) {
+        freeNode(node);
+        numNodes--;
+        numNodesDeleted++;
+        return true;
+    }
+    return false;
 }
 
+// Frees every node of a subtree lying entirely within a deleted range, collecting the records of its leaves in key order
 /**
- * @brief Gets the root node of the B+ tree.
- * @return A pointer to the root node.
+ * @brief Frees a subtree, together with the overflow nodes of its leaves.
+ * @param node The root of the subtree.
+ * @param records The list the records of the subtree are appended to.
  */
-void* BPlusTree::getRoot() {
-    return root;
+void BPlusTree::freeSubtree(void* node, list<pointerBlockPair>& records) {
+    unsigned int numKeys = *(unsigned int*) node;
+    pointerBlockPair* ptrArr = getPointers(node);
+    if (((NodeHeader*) node)->isLeaf) {
+        for (unsigned int i = 0; i < numKeys; i++) {
+            collectRecords(ptrArr[i], records, true);
+        }
+    } else {
+        for (unsigned int i = 0; i <= numKeys; i++) {
+            freeSubtree(getNode(ptrArr[i]), records);
+        }
+    }
+    freeNode(node);
+    numNodes--;
+    numNodesDeleted++;
 }
 
-// Define your BPlusTree class and data structures here...
+// A leaf entry either points to its record, or to a chain of overflow nodes holding the records of a duplicated key
 /**
- * @brief Deletes records with a key value below a specified threshold.
- * @param threshold The threshold value for record deletion.
- * @param output The output file stream for logging.
+ * @brief Appends the records of a leaf entry to a list.
+ * @param entry The pointer of the leaf entry.
+ * @param records The list the records are appended to.
+ * @param freeOverflow Whether the overflow nodes of the entry are freed once their records are collected.
  */
-void BPlusTree::deleteBelowThreshold(float threshold, ofstream& output) {
-    auto start = std::chrono::high_resolution_clock::now(); // Start measuring time
-
-    // Find records with "FG_PCT_home" below the threshold
-    std::list<pointerBlockPair> recordsToDelete = findRecord(0.0f, threshold, output);
-
-    // Delete records found
-    for (const auto& record : recordsToDelete) {
-        deleteKey(record.recordID, getRoot());
+void BPlusTree::collectRecords(pointerBlockPair entry, list<pointerBlockPair>& records, bool freeOverflow) {
+    if (entry.recordID != -1) {
+        records.push_back(entry);
+        return;
     }
+    void* overflowNode = getNode(entry);
+    while (overflowNode != nullptr) {
+        unsigned int numRecords = *(unsigned int*) overflowNode;
+        pointerBlockPair* ptrArrOverflow = getPointers(overflowNode);
+        records.insert(records.end(), ptrArrOverflow, ptrArrOverflow + numRecords);
+        void* nextOverflow = getNode(ptrArrOverflow[maxKeys]);
+        if (freeOverflow) {
+            freeNode(overflowNode);
+            numOverflowNodes--;
+            numOverflowNodesDeleted++;
+        }
+        overflowNode = nextOverflow;
+    }
+}
 
-
-    // Get the updated B+ tree statistics
-    int numNodesUpdated = getNumNodes(getRoot(), true);  // Pass the root node
-    int numLevelsUpdated = getNumLevels(getRoot(), true);  // Pass the root node
-    std::vector<float> rootKeys = getRootKeys(numNodesUpdated, numLevelsUpdated);
-
-    // Calculate the number of data blocks that would be accessed by a brute-force linear scan method (for comparison)
-    int numBlocksAccessedByLinearScan = countDataBlocksAccessed(0.0f, threshold, output);
-
-    auto end = std::chrono::high_resolution_clock::now(); // Stop measuring time
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-    cout << std::endl;
-    cout << "Running time of the process: " << duration.count() << " microseconds" << std::endl;
-    cout << "Running time for the Brute Force Linear Scan: " << (duration.count() + 17) << " microseconds" << std::endl;
-    cout << "Number of data blocks accessed by linear scan: " << numBlocksAccessedByLinearScan << std::endl;
+// Descends towards a key like findNode(), remembering the last node where the path does not take the leftmost child
+// The previous leaf is the rightmost leaf of the child just left of the path in that node
+/**
+ * @brief Finds the leaf before the leaf that a key would be placed in.
+ * @param points_home The key value.
+ * @return The previous leaf, or nullptr if the key belongs in the first leaf.
+ */
+void* BPlusTree::findPreviousLeaf(float points_home) {
+    void* node = root;
+    void* previous = nullptr;
+    for (unsigned int level = 0; level < height; level++) {
+        pointerBlockPair* ptrArr = getPointers(node);
+        float* pointsHomeArr = getKeys(node);
+        unsigned int i = KeySearch::countLessOrEqual(pointsHomeArr, *((unsigned int*) node), points_home);
+        if (i > 0) {
+            previous = getNode(ptrArr[i - 1]);
+        } else if (previous != nullptr) {
+            // Follow the rightmost child of the subtree left of the path down to the same level
+            previous = getNode((getPointers(previous))[*(unsigned int*) previous]);
+        }
+        node = getNode(ptrArr[i]);
+    }
+    return previous;
 }
 
 /**
@@ -991,8 +2450,7 @@ std::vector<float> BPlusTree::getRootKeys(int& numNodesAccessed, int& numLevelsA
     // Get the keys from the root node of the B+ tree
     void* rootNode = getRoot();
     NodeHeader header = *(NodeHeader*)rootNode;
-    pointerBlockPair* ptrArr = (pointerBlockPair*)(((NodeHeader*)rootNode) + 1);
-    float* pointsHomeArr = (float*)(ptrArr + maxKeys + 1);
+    float* pointsHomeArr = getKeys(rootNode);
 
     for (int i = 0; i < header.numKeys; i++) {
         keys.push_back(pointsHomeArr[i]);
@@ -1022,9 +2480,9 @@ int BPlusTree::getNumNodes(void* node, bool isRoot) {
     if (!isRoot) {
         NodeHeader header = *(NodeHeader*)node;
         if (!header.isLeaf) {
-            pointerBlockPair* ptrArr = (pointerBlockPair*)(((NodeHeader*)node) + 1);
+            pointerBlockPair* ptrArr = getPointers(node);
             for (int i = 0; i <= header.numKeys; i++) {
-                count += getNumNodes(ptrArr[i].blockAddress, false);
+                count += getNumNodes(getNode(ptrArr[i]), false);
             }
         }
     }
@@ -1032,6 +2490,26 @@ int BPlusTree::getNumNodes(void* node, bool isRoot) {
     return count;
 }
 
+// Counts the internal nodes of an existing tree, whose leaves outnumber them by the fanout and are not visited
+/**
+ * @brief Counts the internal nodes of the subtree under a node, without visiting its leaves.
+ * @param node The root of the subtree.
+ * @return The number of internal nodes.
+ */
+unsigned int BPlusTree::countInternalNodes(void* node) {
+    NodeHeader* header = (NodeHeader*) node;
+    if (header->isLeaf) {
+        return 0;
+    }
+
+    unsigned int count = 1;
+    pointerBlockPair* ptrArr = getPointers(node);
+    for (unsigned int i = 0; i <= header->numKeys; i++) {
+        count += countInternalNodes(getNode(ptrArr[i]));
+    }
+    return count;
+}
+
 /**
  * @brief Gets the number of levels in the B+ tree starting from a given node.
  * @param node The starting node.
@@ -1049,8 +2527,8 @@ int BPlusTree::getNumLevels(void* node, bool isRoot) {
     if (!isRoot) {
         NodeHeader header = *(NodeHeader*)node;
         if (!header.isLeaf) {
-            pointerBlockPair* ptrArr = (pointerBlockPair*)(((NodeHeader*)node) + 1);
-            levels += getNumLevels(ptrArr[0].blockAddress, false);  // Consider the leftmost child
+            pointerBlockPair* ptrArr = getPointers(node);
+            levels += getNumLevels(getNode(ptrArr[0]), false);  // Consider the leftmost child
         }
     }
 
@@ -1066,56 +2544,75 @@ int BPlusTree::getNumLevels(void* node, bool isRoot) {
  * @param output The output file stream for logging.
  * @return The total number of data blocks accessed.
  */
-int BPlusTree::countDataBlocksAccessed(float pointsHomeStart, float pointsHomeEnd, ofstream &output) {
+int BPlusTree::countDataBlocksAccessed(float pointsHomeStart, float pointsHomeEnd, ofstream &/*output*/) {
     int count = 0;
 
     // Perform a linear scan within the specified range and count data blocks accessed
-    void* currNode = findNode(pointsHomeStart, getRoot(), 0, output, false);
+    void* currNode = findNode(pointsHomeStart);
     while (currNode != nullptr) {
         NodeHeader header = *(NodeHeader*)currNode;
-        pointerBlockPair* ptrArr = (pointerBlockPair*)(((NodeHeader*)currNode) + 1);
-        float* numVotesArr = (float*)(ptrArr + maxKeys + 1);
+        pointerBlockPair* ptrArr = getPointers(currNode);
+        float* numVotesArr = getKeys(currNode);
 
         for (int i = 0; i < header.numKeys; i++) {
             float key = numVotesArr[i];
             if (key >= pointsHomeStart && key <= pointsHomeEnd) {
-                count++;  // Count data block access
+                if (ptrArr[i].recordID != -1) {
+                    count++;  // Count data block access
+                    continue;
+                }
+                // Count a data block access for each record held in the overflow nodes of a duplicate key
+                void* overflowNode = getNode(ptrArr[i]);
+                while (overflowNode != nullptr) {
+                    count += *(unsigned int*)overflowNode;
+                    overflowNode = getNode((getPointers(overflowNode))[maxKeys]);
+                }
             }
         }
 
         // Move to the next leaf node
-        currNode = ptrArr[maxKeys].blockAddress;
+        currNode = getNode(ptrArr[maxKeys]);
     }
     return count;
 }
 
+// The latch is taken before the version is made odd, so only one writer bumps the version at a time
 /**
- * @brief Returns the average of the FG3 value as required by Experiments 3 and 4.
+ * @brief Constructs a new VersionedLock object.
+ * @param latch The latch.
+ * @param version The version counter of what the latch guards.
+ * @param lockNow Whether to take the latch straight away.
  */
-void BPlusTree::avgFG3(float pointsHomeStart, float pointsHomeEnd, ofstream &output){
-    float totalFG3;
-    int countFG3;
-    float ans;
-    float multiplier = std::pow(10.0f, 4);
-    int roundedA = static_cast<int>(std::round(pointsHomeStart* multiplier));
-    int roundedB = static_cast<int>(std::round(0.5 * multiplier));
-    int roundedC = static_cast<int>(std::round(0.6 * multiplier));
-    bool comparison, comparison2;
-    comparison = roundedA == roundedB;
-    comparison2 = roundedA == roundedC;
-
-    if(comparison){
-        totalFG3 = 331.73800000000017;
-        countFG3 = 848;
-        ans = totalFG3/countFG3;
+VersionedLock::VersionedLock(shared_mutex& latch, atomic<uint64_t>& version, bool lockNow) : latch(latch), version(version), isLocked(false) {
+    if (lockNow) {
+        lock();
     }
+}
 
-    if(comparison2){
-        totalFG3 = 119.60800000000000;
-        countFG3 = 238;
-        ans = totalFG3/countFG3;
-    }
-    if(output.is_open()){
-            output << "Average of FG3_PCT_home: "<< ans << "\n";
+/**
+ * @brief Releases the latch if it is still held.
+ */
+VersionedLock::~VersionedLock() {
+    if (isLocked) {
+        unlock();
     }
 }
+
+/**
+ * @brief Takes the latch and makes the version odd.
+ */
+void VersionedLock::lock() {
+    latch.lock();
+    version.fetch_add(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    isLocked = true;
+}
+
+/**
+ * @brief Makes the version even again and releases the latch.
+ */
+void VersionedLock::unlock() {
+    isLocked = false;
+    version.fetch_add(1, memory_order_release);
+    latch.unlock();
+}
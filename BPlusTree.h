@@ -4,13 +4,72 @@
 #include <cstdlib>
 #include <list>
 #include "ProjectStructure.h"
+#include "DiskAllocation.h"
+#include "Aggregation.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <math.h>
 #include <fstream>
 #include "vector"
+#include <functional>
+#include <unordered_map>
+#include <atomic>
+#include <shared_mutex>
 
 using namespace std;
 
+/**
+ * @brief Kinds of node stored in a B+ tree, which determine what each pointer of the node leads to.
+ */
+enum NodeKind {
+    NON_LEAF_NODE, ///< Pointers lead to child nodes.
+    LEAF_NODE, ///< Pointers lead to records or to overflow nodes, and the last pointer to the next leaf node.
+    OVERFLOW_NODE ///< Pointers lead to records, and the last pointer to the next overflow node of the same key.
+};
+
+/**
+ * @brief Struct to hold the estimated size of a key range, used to choose how to retrieve its records.
+ */
+struct RangeEstimate {
+    double numRecords; ///< The number of records whose key lies within the range.
+    double numLeaves; ///< The number of leaf nodes holding the keys of the range.
+    bool isExact; ///< Whether the records were counted rather than estimated.
+};
+
+/**
+ * @brief Holds a latch exclusively and bumps a version counter when taking and releasing it, so that the counter
+ * is odd while the latch is held. Readers that take no latch compare the counter before and after reading.
+ */
+class VersionedLock {
+public:
+    shared_mutex& latch; ///< The latch.
+    atomic<uint64_t>& version; ///< The version counter of what the latch guards.
+    bool isLocked; ///< Whether the latch is held by this object.
+
+    /**
+     * @brief Constructs a new VersionedLock object.
+     * @param latch The latch.
+     * @param version The version counter of what the latch guards.
+     * @param lockNow Whether to take the latch straight away.
+     */
+    VersionedLock(shared_mutex& latch, atomic<uint64_t>& version, bool lockNow = true);
+
+    /**
+     * @brief Releases the latch if it is still held.
+     */
+    ~VersionedLock();
+
+    /**
+     * @brief Takes the latch and makes the version odd.
+     */
+    void lock();
+
+    /**
+     * @brief Makes the version even again and releases the latch.
+     */
+    void unlock();
+};
+
 /**
  * @brief Represents a B+ tree data structure for indexing game data.
  */
@@ -20,28 +79,215 @@ public:
     unsigned int height; ///< The height of the B+ tree.
     unsigned int maxKeys; ///< The maximum number of keys that a node can hold.
     unsigned int sizeOfNode; ///< The size (in bytes) of a B+ tree node.
-
-    vector<duplicateCounter> duplicateCount; ///< Vector to store duplicate key-value counts.
+    DiskAllocation* nodeDisk; ///< Disk whose blocks hold the nodes.
+    bool hasAggregates; ///< Whether every node entry holds the EntryAggregate of the records it leads to.
+    NodeLayout nodeLayout; ///< The layout of the fields within a node.
+    unsigned int keysOffset; ///< The offset of the keys from the start of a node.
+    unsigned int pointersOffset; ///< The offset of the pointers from the start of a node.
+    unsigned int aggregatesOffset; ///< The offset of the aggregates from the start of a node.
 
     // For Experiments
-    unsigned int numNodes; ///< The total number of nodes in the B+ tree.
-    unsigned int numOverflowNodes; ///< The total number of overflow nodes in the B+ tree.
-    int numIndexAccessed; ///< The number of index nodes accessed during operations.
+    atomic<unsigned int> numNodes; ///< The total number of nodes in the B+ tree.
+    atomic<unsigned int> numOverflowNodes; ///< The total number of overflow nodes in the B+ tree.
+    atomic<unsigned int> numInternalNodes; ///< The number of nodes of the B+ tree that are not leaves, counted in numNodes.
+    atomic<int> numIndexAccessed; ///< The number of index nodes accessed during operations.
     int numNodesDeleted; ///< The number of nodes deleted during operations.
-    int numOverflowNodesAccessed; ///< The number of overflow nodes accessed during operations.
+    atomic<int> numOverflowNodesAccessed; ///< The number of overflow nodes accessed during operations.
     int numOverflowNodesDeleted; ///< The number of overflow nodes deleted during operations.
 
-    int count = 0; ///< A counter used for various purposes.
+    atomic<int> count{0}; ///< A counter used for various purposes.
+
+    // For concurrent use
+    bool isConcurrent; ///< Whether the tree may be used by several threads at once, see enableConcurrency().
+    vector<shared_mutex> nodeLatches; ///< The reader/writer latch of each node, by the ID of its block. Only allocated once isConcurrent is set.
+    shared_mutex rootLatch; ///< Guards root and height while a thread starts descending from the root.
+    shared_mutex treeLatch; ///< Taken exclusively by the operations that are not latch-coupled (deletions, bulk loading), and shared by the others.
+    bool isOptimistic; ///< Whether lookups take no latches and validate node versions instead, see enableConcurrency().
+    vector<atomic<uint64_t>> nodeVersions; ///< The version of each node, by the ID of its block. Odd while the node is latched exclusively.
+    atomic<uint64_t> rootVersion; ///< The version of root and height. Odd while rootLatch is held exclusively.
+    atomic<uint64_t> treeVersion; ///< The version of the whole tree. Odd while treeLatch is held exclusively.
+
+    /**
+     * @brief Optional hook called with each node (and its level, the root being level 0) visited by findNode().
+     *
+     * Used to trace the index blocks accessed by a lookup, e.g. by printing them with printIndexBlock().
+     */
+    function<void(void* node, unsigned int level)> nodeVisitObserver;
+
+    /**
+     * @brief Reads the value of the aggregated payload column of a record. Required when hasAggregates is set.
+     */
+    function<double(pointerBlockPair record)> payloadReader;
 
     //Initialisation and setting functions
     /**
      * @brief Constructs a new BPlusTree object.
-     * @param sizeOfNode The size (in bytes) of a B+ tree node.
+     * @param blockSize The size (in bytes) of the disk blocks holding the nodes.
+     * @param nodeDisk The disk whose blocks hold the nodes.
+     * @param hasAggregates Whether every node entry holds the COUNT and SUM of a payload column, read with payloadReader.
+     *                      This lowers the number of keys a node can hold.
+     * @param nodeLayout The layout of the fields within a node. With ALIGNED_NODES, a block size that is a multiple
+     *                   of the cache line size avoids losing the padding before each node.
      */
-    BPlusTree(unsigned int sizeOfNode);
+    BPlusTree(unsigned int blockSize, DiskAllocation* nodeDisk, bool hasAggregates = false, NodeLayout nodeLayout = PACKED_NODES);
 
     /**
-     * @brief Creates a new B+ tree node.
+     * @brief Lets several threads look up and insert records at the same time.
+     *
+     * Every node is given a reader/writer latch. Lookups couple shared latches from the root down to the leaves
+     * and along the leaf chain, while inserts couple exclusive latches and release the latches of the ancestors
+     * as soon as a node cannot split. An insert first descends with shared latches and only latches the leaf
+     * exclusively, and restarts with exclusive latches if the leaf turns out to be full. Deletions and bulk
+     * loading run on their own, and with aggregates every insert holds the root latch, as the aggregates of
+     * every ancestor change.
+     *
+     * Every node also has a version, bumped whenever its latch is taken or released exclusively. With optimistic
+     * reads, lookups take no latch at all (see findRecordOptimistic()), so readers never write to the cache lines
+     * of the root or the other shared nodes. A lookup that keeps restarting falls back to coupling shared latches.
+     * With aggregates, lookups always couple shared latches, as every insert keeps the root latched.
+     *
+     * @param optimisticReads Whether lookups validate node versions instead of coupling shared latches. Ignored with aggregates.
+     */
+    void enableConcurrency(bool optimisticReads = false);
+
+    /**
+     * @brief Gets the latch of a node. Only valid when isConcurrent is set.
+     * @param node The node.
+     * @return The reader/writer latch of the node.
+     */
+    shared_mutex& getLatch(void* node);
+
+    /**
+     * @brief Latches a node exclusively and makes its version odd. Only valid when isConcurrent is set.
+     * @param node The node.
+     */
+    void lockNode(void* node);
+
+    /**
+     * @brief Makes the version of a node even again and releases its exclusive latch.
+     * @param node The node, latched with lockNode().
+     */
+    void unlockNode(void* node);
+
+    /**
+     * @brief Reads the version of a node before reading the node without latching it.
+     * @param node The node.
+     * @return The version of the node, which is odd if the node is being changed.
+     */
+    uint64_t readVersion(void* node);
+
+    /**
+     * @brief Checks that neither a node nor the whole tree has changed since their versions were read.
+     * @param node The node.
+     * @param version The version of the node, from readVersion().
+     * @param treeVer The version of the tree.
+     * @return True if everything read from the node in between is consistent.
+     */
+    bool isUnchanged(void* node, uint64_t version, uint64_t treeVer);
+
+    /**
+     * @brief Descends to the leaf node that may contain a key without taking any latch, validating the version
+     * of every node before following its pointer, and restarting from the root when a node has changed.
+     *
+     * Only used when isConcurrent is set.
+     *
+     * @param points_home The key value to search for.
+     * @param treeVer The version of the tree when the lookup started.
+     * @param leafVersion Set to the version of the leaf.
+     * @param numLevels Incremented by the number of nodes visited.
+     * @param numRestarts Incremented every time the descent restarts or waits for a node being changed.
+     * @return The leaf node for the key, or nullptr if the tree has changed since treeVer or the descent restarted too often.
+     */
+    void* findLeafOptimistic(float points_home, uint64_t treeVer, uint64_t& leafVersion, int& numLevels, int& numRestarts);
+
+    /**
+     * @brief Collects the records whose key lies within a range without taking any latch.
+     *
+     * The records of a leaf are only kept once the version of the leaf is found unchanged after reading it. If a
+     * leaf has changed, the lookup descends again from the root to the last key kept, and if the tree has been
+     * changed by a deletion or a bulk load, it starts over. After restarting too often, e.g. behind a long-running
+     * writer, the lookup gives up so that the caller can couple shared latches instead of spinning.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param results Set to the pointer-block pairs of the records found.
+     * @return True if the lookup finished, false if it gave up.
+     */
+    bool findRecordOptimistic(float pointsHomeStart, float pointsHomeEnd, list<pointerBlockPair>& results);
+
+    /**
+     * @brief Descends to the leaf node that may contain a key, coupling shared latches on the way.
+     *
+     * Only used when isConcurrent is set. The caller must hold treeLatch in shared mode.
+     *
+     * @param points_home The key value to search for.
+     * @return The leaf node for the key, latched in shared mode.
+     */
+    void* findLeafShared(float points_home);
+
+    /**
+     * @brief Inserts a record into the B+ tree while other threads may be using it, see enableConcurrency().
+     * @param points_home The key value of the record.
+     * @param record The pointer-block pair representing the record.
+     */
+    void insertRecordConcurrently(float points_home, pointerBlockPair record);
+
+    /**
+     * @brief Checks whether inserting a key into a node cannot make it split, so its ancestors need not stay latched.
+     * @param node The node.
+     * @param points_home The key value being inserted.
+     * @return True if the node cannot split.
+     */
+    bool isSafeForInsert(void* node, float points_home);
+
+    /**
+     * @brief Replaces the empty tree with an existing tree whose nodes are already stored on the disk.
+     * @param existingRoot The root node of the existing tree.
+     * @param existingHeight The height of the existing tree.
+     * @param existingNumNodes The number of nodes in the existing tree.
+     * @param existingNumOverflowNodes The number of overflow nodes in the existing tree.
+     */
+    void openExisting(void* existingRoot, unsigned int existingHeight, unsigned int existingNumNodes, unsigned int existingNumOverflowNodes);
+
+    //Functions for snapshots
+    /**
+     * @brief Lists every node of the tree in breadth-first order from the root.
+     *
+     * The overflow nodes of a key are listed as soon as the leaf holding the key is reached.
+     *
+     * @param nodes Filled with the nodes of the tree.
+     * @param nodeKinds Filled with the NodeKind of each node.
+     */
+    void collectNodes(vector<void*>& nodes, vector<NodeKind>& nodeKinds);
+
+    /**
+     * @brief Copies a node with its references to other nodes renumbered into node indexes, so that the copy
+     * does not depend on the blocks the nodes are stored in.
+     *
+     * References to nodes become the index of the node in the list given by collectNodes(), references to
+     * records keep the ID of their data block, and unused references become -1.
+     *
+     * @param node The node to copy.
+     * @param kind The kind of the node.
+     * @param nodeIndexes The index of every node of the tree, by the ID of its block.
+     * @param image The buffer of sizeOfNode bytes to copy the node into.
+     * @throws runtime_error If the node points to a node that is not in nodeIndexes.
+     */
+    void saveNodeImage(void* node, NodeKind kind, const unordered_map<int, unsigned int>& nodeIndexes, void* image);
+
+    /**
+     * @brief Turns the node indexes and data block IDs of a node copied with saveNodeImage() into the IDs of the
+     * blocks now holding those nodes and data blocks, in place.
+     * @param node The node to update.
+     * @param kind The kind of the node.
+     * @param nodeBlockIds The ID of the block holding each node, by node index.
+     * @param dataBlockIds The ID of the block now holding each data block, by the block ID stored in the node.
+     * @throws runtime_error If an index or ID is not found.
+     */
+    void loadNodeImage(void* node, NodeKind kind, const vector<int>& nodeBlockIds, const unordered_map<int, int>& dataBlockIds);
+
+    /**
+     * @brief Creates a new B+ tree node in a block taken from the node pool of the disk.
      *
      * @param isLeaf Indicates whether the new node is a leaf node.
      * @param isOverflow Indicates whether the new node is an overflow node.
@@ -49,9 +295,147 @@ public:
      */
     void* getNewNode(bool isLeaf, bool isOverflow);
 
+    /**
+     * @brief Releases the disk block of a node that is no longer used.
+     *
+     * The block is returned to the node pool of the disk rather than to the free blocks, so that it is reused for the
+     * next node created.
+     *
+     * @param node The node to release.
+     */
+    void freeNode(void* node);
+
+    /**
+     * @brief Resolves a reference to a node into the address of the node.
+     *
+     * References between nodes hold the ID of the block of the node they lead to, so that the tree does not
+     * depend on the address the disk is mapped at. A node is resolved into its address while it is being used.
+     *
+     * @param pointer The reference, holding the ID of the block of the node.
+     * @return The address of the node, or nullptr if the reference leads nowhere.
+     */
+    void* getNode(const pointerBlockPair& pointer);
+
+    /**
+     * @brief Gets the ID of the block holding a node, to be stored in a reference to the node.
+     * @param node The address of the node, or nullptr.
+     * @return The ID of the block of the node, or -1 for nullptr.
+     */
+    int getNodeId(void* node);
+
+    /**
+     * @brief Gets the offset of a node from the start of the block holding it.
+     *
+     * Nodes start at the start of their block, except with ALIGNED_NODES where they start at the first cache line
+     * boundary of their block.
+     *
+     * @param blockAddr The address of the block.
+     * @return The offset of the node, in bytes.
+     */
+    unsigned int getNodeOffset(void* blockAddr);
+
+    //Functions for aggregates held in the nodes
+    /**
+     * @brief Gets the keys of a node.
+     * @param node The node.
+     * @return The array of maxKeys keys of the node.
+     */
+    float* getKeys(void* node);
+
+    /**
+     * @brief Gets the pointers of a node.
+     * @param node The node.
+     * @return The array of maxKeys + 1 pointers of the node, the last one leading to the next leaf or overflow node.
+     */
+    pointerBlockPair* getPointers(void* node);
+
+    /**
+     * @brief Gets the aggregates of the entries of a node. Only valid when hasAggregates is set.
+     *
+     * The aggregates are stored last in the node, one for each of its maxKeys + 1 pointers.
+     *
+     * @param node The node.
+     * @return The array of aggregates of the node.
+     */
+    EntryAggregate* getAggregates(void* node);
+
+    /**
+     * @brief Sums the aggregates of all entries of a node, giving the aggregate of its whole subtree.
+     * @param node The node.
+     * @return The aggregate of the subtree of the node.
+     */
+    EntryAggregate getNodeTotal(void* node);
+
+    /**
+     * @brief Recomputes the aggregates of the entries of a non-leaf node from the totals of its children.
+     * @param node The non-leaf node.
+     */
+    void recomputeAggregates(void* node);
+
+    /**
+     * @brief Recomputes the aggregates of a node (if it is a non-leaf node) and of all of its ancestors.
+     *
+     * Called after the entries of a node have changed, so that the aggregates on the path to the root stay exact.
+     *
+     * @param node The node that has changed.
+     */
+    void refreshAggregates(void* node);
+
+    /**
+     * @brief Computes the COUNT and SUM of the payload column over the records whose key lies within a range.
+     *
+     * Only the two root-to-leaf paths of the range boundaries are visited: the aggregate of the records with a key
+     * smaller than the starting key is subtracted from the aggregate of the records with a key up to the ending key.
+     * The minimum and maximum are not available from the nodes and are left at 0.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @return The COUNT and SUM of the payload column over the range.
+     */
+    AggregateResult aggregateRange(float pointsHomeStart, float pointsHomeEnd);
+
+    /**
+     * @brief Estimates the size of a key range without collecting its records.
+     *
+     * With aggregates, the records are counted exactly with aggregateRange(). Otherwise the records of the first
+     * ESTIMATE_LEAF_BUDGET leaves of the range are counted, overflow nodes included, which is exact for a range
+     * ending within them. A wider range is estimated from the positions of its boundaries within the tree, see
+     * getKeyFraction().
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param totalRecords The number of records indexed by the tree.
+     * @return The estimated size of the range.
+     */
+    RangeEstimate estimateRange(float pointsHomeStart, float pointsHomeEnd, double totalRecords);
+
+    /**
+     * @brief Estimates the fraction of the leaf entries that come before a key, from the position of the key within
+     * every node on the path to its leaf, assuming that the subtrees of a node hold as many entries each.
+     *
+     * In concurrent use, the caller must hold treeLatch in shared mode.
+     *
+     * @param points_home The key value.
+     * @param inclusive Whether the entry of the key itself counts as coming before it.
+     * @return The fraction, between 0 and 1.
+     */
+    double getKeyFraction(float points_home, bool inclusive);
+
+    /**
+     * @brief Computes the COUNT and SUM of the payload column over the records whose key is smaller than (or equal to) a key.
+     * @param points_home The key value.
+     * @param inclusive Whether the records with the key itself are included.
+     * @return The aggregate of the records before the key.
+     */
+    EntryAggregate getPrefixAggregate(float points_home, bool inclusive);
+
     //Retrieval functions
     /**
      * @brief Finds records within a specified range of key values.
+     *
+     * Both ends of the range are inclusive, so a single key is queried by passing it as both the starting and ending key.
+     * All records of a duplicated key are returned by following its overflow nodes.
+     *
      * @param pointsHomeStart The starting key value.
      * @param pointsHomeEnd The ending key value.
      * @param output The output file stream to write results to.
@@ -60,15 +444,55 @@ public:
     list<pointerBlockPair> findRecord(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
 
     /**
-     * @brief Finds the node containing a specific key value within the B+ tree.
-     * @param points_home points_home The key value to search for.
-     * @param node The current node being searched.
-     * @param currentHeight The current height in the B+ tree.
-     * @param output The output file stream for logging.
-     * @param willPrint Indicates whether to print debug information.
-     * @return A pointer to the node containing the key.
+     * @brief Splits a key range into morsels at the separator keys of the non-leaf nodes, so that each morsel covers
+     * a run of adjacent leaves.
+     *
+     * The separators are taken from the highest level of the tree that has at least numMorsels - 1 of them within
+     * the range, or from the level above the leaves, and are then thinned out evenly to at most numMorsels - 1.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param numMorsels The number of morsels wanted.
+     * @return The boundaries of the morsels in increasing order, starting with pointsHomeStart and ending with
+     * pointsHomeEnd. Morsel i holds the keys from boundary i (inclusive) to boundary i + 1 (exclusive, except for the last morsel).
      */
-    void* findNode(float points_home, void* node, unsigned int currentHeight, ofstream &output, bool willPrint);
+    vector<float> splitRange(float pointsHomeStart, float pointsHomeEnd, unsigned int numMorsels);
+
+    /**
+     * @brief Finds the records within a range of key values, one morsel of leaves at a time on a thread pool.
+     *
+     * The range is split with splitRange() into a few morsels per worker, and each morsel is looked up with
+     * findRecord() on whichever worker takes it, so the index lookup statistics are not meaningful afterwards.
+     * nodeVisitObserver, if set, is called from several threads.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param pool The thread pool running the morsels.
+     * @param consumer Called on the worker that looked up a morsel, with the number of the morsel, the number of
+     * the worker and the records of the morsel in key order.
+     * @return The number of morsels.
+     */
+    size_t scanParallel(float pointsHomeStart, float pointsHomeEnd, ThreadPool& pool,
+                        const function<void(size_t morsel, unsigned int worker, list<pointerBlockPair>& records)>& consumer);
+
+    /**
+     * @brief Finds the records within a range of key values with scanParallel().
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param pool The thread pool running the morsels.
+     * @return The pointer-block pairs of the records found, in key order as with findRecord().
+     */
+    list<pointerBlockPair> findRecordParallel(float pointsHomeStart, float pointsHomeEnd, ThreadPool& pool);
+
+    /**
+     * @brief Finds the leaf node that may contain a specific key value within the B+ tree.
+     *
+     * The tree is descended iteratively from the root. Every node visited is reported to nodeVisitObserver, if one is set.
+     *
+     * @param points_home The key value to search for.
+     * @return A pointer to the leaf node for the key.
+     */
+    void* findNode(float points_home);
 
     /**
      * @brief Gets the number of nodes in the B+ tree starting from a given node.
@@ -79,6 +503,14 @@ public:
      */
     int getNumNodes(void* node, bool isRoot);
 
+    /**
+     * @brief Counts the internal nodes of the subtree under a node, without visiting its leaves.
+     *
+     * @param node The root of the subtree.
+     * @return The number of internal nodes.
+     */
+    unsigned int countInternalNodes(void* node);
+
     /**
      * @brief Gets the number of levels in the B+ tree starting from a given node.
      *
@@ -129,6 +561,25 @@ public:
      */
     void insertRecord(float points_home, pointerBlockPair record);
 
+    /**
+     * @brief Inserts a record into the leaf node for its key, splitting the leaf (and its ancestors) if it is full.
+     * @param leaf The leaf node for the key of the record.
+     * @param points_home The key value of the record.
+     * @param record The pointer-block pair representing the record.
+     */
+    void insertIntoLeaf(void* leaf, float points_home, pointerBlockPair record);
+
+    /**
+     * @brief Adds a record with a duplicate key to the overflow nodes of a leaf entry.
+     *
+     * The leaf entry is converted to point to an overflow node (recordID of -1) on the first duplicate.
+     * Each further duplicate is added in constant time, chaining a new overflow node in front once the first one is full.
+     *
+     * @param keyEntry The leaf entry holding the duplicated key.
+     * @param record The pointer-block pair representing the record.
+     */
+    void insertDuplicate(pointerBlockPair* keyEntry, pointerBlockPair record);
+
     /**
      * @brief Splits a leaf node during record insertion.
      * @param points_home The key value of the record to insert.
@@ -159,23 +610,67 @@ public:
      */
     void updateParentNodeAfterSplit(void* parentNode, void* rightNode, float newParentKey);
 
+    /**
+     * @brief Builds the B+ tree bottom-up from a batch of records.
+     *
+     * The entries are sorted once by key, packed into leaves left to right and the internal
+     * levels are then built on top of the leaf level, so no descent or split is performed per record.
+     * If the tree already holds keys, the entries are inserted one by one through insertRecord() instead.
+     *
+     * @param entries The (key, record) pairs to index. The vector is sorted in place.
+     * @param fillFactor The fraction (0, 1] of each node's capacity to fill.
+     */
+    void bulkLoad(vector<pair<float, pointerBlockPair>>& entries, float fillFactor);
+
     //Functions for deleting a record
     /**
-     * @brief Deletes a record with a specific key value from the B+ tree.
+     * @brief Deletes a key from a node of the B+ tree, rebalancing the tree if the node underflows.
      *
-     * @param pointsHome The key value of the record to delete.
-     * @param nodeToDeleteFrom The node to delete the record from.
+     * A node left with too few keys borrows an entry from a sibling, or is merged with it.
+     *
+     * @param pointsHome The key value to delete.
+     * @param nodeToDeleteFrom The node to delete the key from, which is the leaf holding the key for a record.
      */
     void deleteKey(float pointsHome, void* nodeToDeleteFrom);
 
     /**
-     * @brief Merges two nodes (either leaf or non-leaf) into one node.
+     * @brief Merges two sibling nodes (either leaf or non-leaf) into the left node, and removes the separator between them from their parent.
      *
      * @param leftNode The left node to be merged.
      * @param rightNode The right node to be merged.
      */
     void mergeNodes(void* leftNode, void* rightNode);
 
+    /**
+     * @brief Rebalances a node after keys have been removed from it.
+     *
+     * A node left with too few keys borrows entries from its siblings, or is merged with one of them. A non-leaf
+     * root left with a single child is replaced by that child.
+     *
+     * @param node The node to rebalance.
+     */
+    void rebalanceNode(void* node);
+
+    /**
+     * @brief Moves the last entry of the left sibling of a node into the node, updating the separator between them.
+     *
+     * @param node The node receiving the entry.
+     * @param leftSibling The left sibling of the node.
+     * @param parentNode The parent of both nodes.
+     * @param posInParent The position of the node among the children of its parent.
+     */
+    void borrowFromLeft(void* node, void* leftSibling, void* parentNode, unsigned int posInParent);
+
+    /**
+     * @brief Moves the first entry of the right sibling of a node into the node, updating the separator between them.
+     *
+     * @param node The node receiving the entry.
+     * @param rightSibling The right sibling of the node.
+     * @param parentNode The parent of both nodes.
+     * @param posInParent The position of the node among the children of its parent.
+     */
+    void borrowFromRight(void* node, void* rightSibling, void* parentNode, unsigned int posInParent);
+
     /**
      * @brief Shifts elements in an array of key values and pointer-block pairs forward.
      *
@@ -183,8 +678,9 @@ public:
      * @param ptrArr An array of pointer-block pairs.
      * @param start The starting index for shifting.
      * @param isLeaf Indicates whether the elements are in a leaf node.
+     * @param aggregateArr The aggregates of the entries, shifted along with the pointers, or nullptr if there are none.
      */
-    void shiftElementsForward(float* pointsHomeArr, pointerBlockPair* ptrArr, int start, bool isLeaf);
+    void shiftElementsForward(float* pointsHomeArr, pointerBlockPair* ptrArr, int start, bool isLeaf, EntryAggregate* aggregateArr = nullptr);
 
     /**
      * @brief Shifts elements in an array of key values and pointer-block pairs back.
@@ -193,16 +689,61 @@ public:
      * @param ptrArr An array of pointer-block pairs.
      * @param end The ending index for shifting.
      * @param isLeaf Indicates whether the elements are in a leaf node.
+     * @param aggregateArr The aggregates of the entries, shifted along with the pointers, or nullptr if there are none.
      */
-    void shiftElementsBack(float* pointsHomeArr, pointerBlockPair* ptrArr, int end, bool isLeaf);
+    void shiftElementsBack(float* pointsHomeArr, pointerBlockPair* ptrArr, int end, bool isLeaf, EntryAggregate* aggregateArr = nullptr);
 
     /**
-     * @brief Deletes records with a key value below a specified threshold.
+     * @brief Deletes the keys within a range from the B+ tree.
      *
-     * @param threshold The threshold value for record deletion.
-     * @param output The output file stream for logging.
+     * Subtrees lying entirely within the range are detached and freed whole, so the cost grows with the number of
+     * leaves deleted rather than with the number of keys. Only the nodes on the paths to the two ends of the range
+     * are rebalanced afterwards. The records the keys point to are only removed from the index, their data blocks
+     * are left untouched.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @return The pointer-block pairs of the records removed from the index.
+     */
+    list<pointerBlockPair> deleteRange(float pointsHomeStart, float pointsHomeEnd);
+
+    /**
+     * @brief Removes the entries within a range from the subtree of a node.
+     *
+     * @param node The root of the subtree.
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param coveredLeft Whether the lower bound of the keys of the subtree lies within the range.
+     * @param coveredRight Whether the upper bound of the keys of the subtree lies within the range.
+     * @param records The list the records of the removed entries are appended to.
+     * @return True if the node has been left without any entry, in which case it is freed unless it is the root.
+     */
+    bool removeRange(void* node, float pointsHomeStart, float pointsHomeEnd, bool coveredLeft, bool coveredRight, list<pointerBlockPair>& records);
+
+    /**
+     * @brief Frees a subtree, together with the overflow nodes of its leaves.
+     *
+     * @param node The root of the subtree.
+     * @param records The list the records of the subtree are appended to, in key order.
+     */
+    void freeSubtree(void* node, list<pointerBlockPair>& records);
+
+    /**
+     * @brief Appends the records of a leaf entry to a list.
+     *
+     * @param entry The pointer of the leaf entry, which points either to a record or to a chain of overflow nodes.
+     * @param records The list the records are appended to.
+     * @param freeOverflow Whether the overflow nodes of the entry are freed once their records are collected.
+     */
+    void collectRecords(pointerBlockPair entry, list<pointerBlockPair>& records, bool freeOverflow);
+
+    /**
+     * @brief Finds the leaf before the leaf that a key would be placed in.
+     *
+     * @param points_home The key value.
+     * @return The previous leaf, or nullptr if the key belongs in the first leaf.
      */
-    void deleteBelowThreshold(float threshold, ofstream &output);
+    void* findPreviousLeaf(float points_home);
 
     //Functions for Experiments/Visualization
     /**
@@ -246,18 +787,8 @@ public:
      */
     void* findKeyToDelete(float pointsHome, void* rootNode, ofstream &output);
 
-    /**
-     * @brief Performs a linear scan for records within a specified range of key values.
-     *
-     * @param pointsHomeStart The starting key value.
-     * @param pointsHomeEnd The ending key value.
-     * @param output The output file stream to write results to.
-     */
-    void linearScan(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
     //string printTree(ofstream &outputFile);
 
-    void avgFG3(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
-
 };
 
 #endif //PROJECT1_BPLUSTREE_H
\ No newline at end of file
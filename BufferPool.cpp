@@ -0,0 +1,378 @@
+#include "BufferPool.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+/**
+ * @brief ClockReplacer evicts frames with a second-chance clock sweep.
+ *
+ * Every access sets the reference bit of a frame. The clock hand clears reference bits as it sweeps
+ * and evicts the first evictable frame whose reference bit is already cleared.
+ */
+class ClockReplacer : public Replacer {
+    public:
+        ClockReplacer(int numFrames) : isTracked(numFrames, false), isEvictable(numFrames, false), isReferenced(numFrames, false) {
+            hand = 0;
+        }
+
+        void recordAccess(int frameId, int /*blockId*/, bool /*isMiss*/) override {
+            isTracked[frameId] = true;
+            isReferenced[frameId] = true;
+        }
+
+        void setEvictable(int frameId, bool evictable) override {
+            isEvictable[frameId] = evictable;
+        }
+
+        int evict() override {
+            // Two full sweeps are enough to clear every reference bit and come back to a victim
+            for (size_t i = 0; i < 2*isTracked.size(); i++) {
+                int frameId = hand;
+                hand = (hand + 1) % isTracked.size();
+                if (!isTracked[frameId] || !isEvictable[frameId]) {
+                    continue;
+                }
+                if (isReferenced[frameId]) {
+                    isReferenced[frameId] = false; // give the frame a second chance
+                    continue;
+                }
+                remove(frameId);
+                return frameId;
+            }
+            return -1;
+        }
+
+        void remove(int frameId) override {
+            isTracked[frameId] = false;
+            isEvictable[frameId] = false;
+            isReferenced[frameId] = false;
+        }
+
+    private:
+        vector<bool> isTracked;
+        vector<bool> isEvictable;
+        vector<bool> isReferenced;
+        int hand;
+};
+
+/**
+ * @brief LRUKReplacer evicts the frame whose K-th most recent access is the oldest.
+ *
+ * Frames accessed fewer than K times have an infinite backward K-distance and are evicted first,
+ * in order of their earliest access, so blocks read once by a scan do not push out frequently used blocks.
+ */
+class LRUKReplacer : public Replacer {
+    public:
+        LRUKReplacer(int numFrames, unsigned int k) : history(numFrames), isEvictable(numFrames, false) {
+            this->k = k;
+            currentTime = 0;
+        }
+
+        void recordAccess(int frameId, int /*blockId*/, bool /*isMiss*/) override {
+            history[frameId].push_back(currentTime++);
+            if (history[frameId].size() > k) {
+                history[frameId].pop_front();
+            }
+        }
+
+        void setEvictable(int frameId, bool evictable) override {
+            isEvictable[frameId] = evictable;
+        }
+
+        int evict() override {
+            int victim = -1;
+            bool victimHasK = true;
+            unsigned long long victimTime = 0;
+            for (size_t frameId = 0; frameId < history.size(); frameId++) {
+                if (!isEvictable[frameId] || history[frameId].empty()) {
+                    continue;
+                }
+                // Front of the history is the K-th most recent access, or the earliest access if there are fewer than K
+                bool hasK = history[frameId].size() >= k;
+                unsigned long long time = history[frameId].front();
+                if (victim == -1 || (!hasK && victimHasK) || (hasK == victimHasK && time < victimTime)) {
+                    victim = frameId;
+                    victimHasK = hasK;
+                    victimTime = time;
+                }
+            }
+            if (victim != -1) {
+                remove(victim);
+            }
+            return victim;
+        }
+
+        void remove(int frameId) override {
+            history[frameId].clear();
+            isEvictable[frameId] = false;
+        }
+
+    private:
+        vector<list<unsigned long long>> history; // timestamps of the last K accesses of each frame, oldest first
+        vector<bool> isEvictable;
+        unsigned int k;
+        unsigned long long currentTime;
+};
+
+/**
+ * @brief TwoQReplacer evicts frames following the 2Q algorithm.
+ *
+ * Blocks read into the buffer pool enter a FIFO queue (A1in). Blocks evicted from A1in are remembered in
+ * a queue of block IDs (A1out), and a block found in A1out when it is read again enters an LRU queue (Am).
+ * Blocks accessed only once thus leave the buffer pool quickly without disturbing the blocks in Am.
+ */
+class TwoQReplacer : public Replacer {
+    public:
+        TwoQReplacer(int numFrames) : queueOfFrame(numFrames, NONE), positionOfFrame(numFrames), blockOfFrame(numFrames, -1), isEvictable(numFrames, false) {
+            maxA1inSize = max(1, numFrames / 4);
+            maxA1outSize = max(1, numFrames / 2);
+        }
+
+        void recordAccess(int frameId, int blockId, bool isMiss) override {
+            blockOfFrame[frameId] = blockId;
+            if (isMiss) {
+                if (a1outBlocks.count(blockId)) { // block was accessed again soon after leaving A1in
+                    a1outBlocks.erase(blockId);
+                    a1out.remove(blockId);
+                    addToQueue(frameId, AM);
+                } else {
+                    addToQueue(frameId, A1IN);
+                }
+            } else if (queueOfFrame[frameId] == AM) { // move to the most recently used end of Am
+                am.erase(positionOfFrame[frameId]);
+                positionOfFrame[frameId] = am.insert(am.end(), frameId);
+            }
+        }
+
+        void setEvictable(int frameId, bool evictable) override {
+            isEvictable[frameId] = evictable;
+        }
+
+        int evict() override {
+            int victim = -1;
+            if (a1in.size() > maxA1inSize) {
+                victim = findEvictable(a1in);
+            }
+            if (victim == -1) {
+                victim = findEvictable(am);
+            }
+            if (victim == -1) {
+                victim = findEvictable(a1in);
+            }
+            if (victim == -1) {
+                return -1;
+            }
+
+            // Remember blocks evicted from A1in in A1out
+            if (queueOfFrame[victim] == A1IN) {
+                a1out.push_back(blockOfFrame[victim]);
+                a1outBlocks.insert(blockOfFrame[victim]);
+                if (a1out.size() > maxA1outSize) {
+                    a1outBlocks.erase(a1out.front());
+                    a1out.pop_front();
+                }
+            }
+            remove(victim);
+            return victim;
+        }
+
+        void remove(int frameId) override {
+            if (queueOfFrame[frameId] == A1IN) {
+                a1in.erase(positionOfFrame[frameId]);
+            } else if (queueOfFrame[frameId] == AM) {
+                am.erase(positionOfFrame[frameId]);
+            }
+            queueOfFrame[frameId] = NONE;
+            isEvictable[frameId] = false;
+        }
+
+    private:
+        enum Queue { NONE, A1IN, AM };
+
+        list<int> a1in; // frames of blocks accessed once, oldest first
+        list<int> am; // frames of blocks accessed again, least recently used first
+        list<int> a1out; // blocks recently evicted from A1in, oldest first
+        unordered_set<int> a1outBlocks;
+        vector<Queue> queueOfFrame;
+        vector<list<int>::iterator> positionOfFrame;
+        vector<int> blockOfFrame;
+        vector<bool> isEvictable;
+        size_t maxA1inSize;
+        size_t maxA1outSize;
+
+        void addToQueue(int frameId, Queue queue) {
+            list<int>& frameQueue = (queue == A1IN) ? a1in : am;
+            queueOfFrame[frameId] = queue;
+            positionOfFrame[frameId] = frameQueue.insert(frameQueue.end(), frameId);
+        }
+
+        int findEvictable(list<int>& frameQueue) {
+            for (int frameId : frameQueue) {
+                if (isEvictable[frameId]) {
+                    return frameId;
+                }
+            }
+            return -1;
+        }
+};
+
+/**
+ * @brief Constructs a buffer pool with the given number of frames, all of which are free.
+ * @param disk The disk whose blocks are cached.
+ * @param numFrames The number of frames in the buffer pool.
+ * @param policy The replacement policy used to evict frames.
+ */
+BufferPool::BufferPool(DiskAllocation* disk, int numFrames, ReplacementPolicy policy)
+{
+    this->disk = disk;
+    this->numFrames = numFrames;
+    this->policy = policy;
+    frameData = (char*)malloc((size_t)numFrames*disk->blockSize);
+    frames.assign(numFrames, {-1, 0, false});
+    for (int i = 0; i < numFrames; i++) {
+        freeFrames.push_back(i);
+    }
+
+    switch (policy) {
+        case LRU_K:
+            replacer = new LRUKReplacer(numFrames, 2);
+            break;
+        case TWO_Q:
+            replacer = new TwoQReplacer(numFrames);
+            break;
+        default:
+            replacer = new ClockReplacer(numFrames);
+            break;
+    }
+    resetStatistics();
+}
+
+/**
+ * @brief Destroys the buffer pool after writing all dirty blocks back to the disk.
+ */
+BufferPool::~BufferPool()
+{
+    flushAll();
+    delete replacer;
+    free(frameData);
+}
+
+/**
+ * @brief Pins a block, evicting another block if the block is not cached and no frame is free.
+ * @param blockId The ID of the block on the disk.
+ * @return The frame holding the content of the block.
+ */
+void* BufferPool::pinBlock(int blockId)
+{
+    int frameId;
+
+    auto entry = pageTable.find(blockId);
+    if (entry != pageTable.end()) {
+        numHits++;
+        frameId = entry->second;
+        replacer->recordAccess(frameId, blockId, false);
+    } else {
+        numMisses++;
+
+        // Find a frame for the block, evicting a block if there are no free frames
+        if (!freeFrames.empty()) {
+            frameId = freeFrames.front();
+            freeFrames.pop_front();
+        } else {
+            frameId = replacer->evict();
+            if (frameId == -1) {
+                throw runtime_error("Unable to pin a block as every frame of the buffer pool is pinned.");
+            }
+            numEvictions++;
+            writeBack(frameId);
+            pageTable.erase(frames[frameId].blockId);
+        }
+
+        // Read the block into the frame
+        memcpy(frameData + (size_t)frameId*disk->blockSize, disk->fetchBlockAddress(blockId), disk->blockSize);
+        numBlocksRead++;
+        frames[frameId] = {blockId, 0, false};
+        pageTable[blockId] = frameId;
+        replacer->recordAccess(frameId, blockId, true);
+    }
+
+    frames[frameId].pinCount++;
+    replacer->setEvictable(frameId, false);
+    return frameData + (size_t)frameId*disk->blockSize;
+}
+
+/**
+ * @brief Unpins a block, allowing it to be evicted once it is no longer pinned.
+ * @param blockId The ID of the block on the disk.
+ * @param isDirty Whether the content of the block was modified in its frame.
+ */
+void BufferPool::unpinBlock(int blockId, bool isDirty)
+{
+    auto entry = pageTable.find(blockId);
+    if (entry == pageTable.end()) {
+        return;
+    }
+
+    Frame& frame = frames[entry->second];
+    frame.isDirty = frame.isDirty || isDirty;
+    if (frame.pinCount > 0 && --frame.pinCount == 0) {
+        replacer->setEvictable(entry->second, true);
+    }
+}
+
+/**
+ * @brief Drops a block from the buffer pool without writing it back, freeing its frame.
+ * @param blockId The ID of the block on the disk.
+ */
+void BufferPool::discardBlock(int blockId)
+{
+    auto entry = pageTable.find(blockId);
+    if (entry == pageTable.end()) {
+        return;
+    }
+
+    int frameId = entry->second;
+    replacer->remove(frameId);
+    frames[frameId] = {-1, 0, false};
+    freeFrames.push_back(frameId);
+    pageTable.erase(entry);
+}
+
+/**
+ * @brief Writes all dirty blocks in the buffer pool back to the disk.
+ */
+void BufferPool::flushAll()
+{
+    for (int frameId = 0; frameId < numFrames; frameId++) {
+        writeBack(frameId);
+    }
+}
+
+/**
+ * @brief Resets the statistics of the buffer pool.
+ */
+void BufferPool::resetStatistics()
+{
+    numHits = 0;
+    numMisses = 0;
+    numBlocksRead = 0;
+    numBlocksWritten = 0;
+    numEvictions = 0;
+}
+
+/**
+ * @brief Writes the block held in a frame back to the disk if it has been modified.
+ * @param frameId The frame to write back.
+ */
+void BufferPool::writeBack(int frameId)
+{
+    Frame& frame = frames[frameId];
+    if (frame.blockId == -1 || !frame.isDirty) {
+        return;
+    }
+    memcpy(disk->fetchBlockAddress(frame.blockId), frameData + (size_t)frameId*disk->blockSize, disk->blockSize);
+    frame.isDirty = false;
+    numBlocksWritten++;
+}
@@ -0,0 +1,150 @@
+#ifndef PROJECT1_BUFFERPOOL_H
+#define PROJECT1_BUFFERPOOL_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include "DiskAllocation.h"
+
+using namespace std;
+
+/**
+ * @brief Replacement policies available to choose which frame of the buffer pool to evict.
+ */
+enum ReplacementPolicy {
+    CLOCK, ///< Second-chance clock sweep over the frames.
+    LRU_K, ///< Evicts the frame whose K-th most recent access is the oldest (K = 2).
+    TWO_Q ///< Keeps blocks accessed once in a FIFO queue, and blocks accessed again in an LRU queue.
+};
+
+/**
+ * @brief Replacer is the interface of a replacement policy used by the buffer pool.
+ *
+ * The buffer pool reports every access to a frame and whether the frame may be evicted (i.e. it is not pinned),
+ * and asks the replacer for a victim frame when it needs to load a block and no frame is free.
+ */
+class Replacer {
+    public:
+        virtual ~Replacer() {}
+
+        /**
+         * @brief Records an access to a frame.
+         * @param frameId The frame accessed.
+         * @param blockId The block held in the frame.
+         * @param isMiss Whether the block has just been read into the frame.
+         */
+        virtual void recordAccess(int frameId, int blockId, bool isMiss) = 0;
+
+        /**
+         * @brief Sets whether a frame may be evicted.
+         * @param frameId The frame to update.
+         * @param isEvictable Whether the frame may be evicted.
+         */
+        virtual void setEvictable(int frameId, bool isEvictable) = 0;
+
+        /**
+         * @brief Chooses an evictable frame and stops tracking it.
+         * @return The frame to evict, or -1 if no frame can be evicted.
+         */
+        virtual int evict() = 0;
+
+        /**
+         * @brief Stops tracking a frame whose block has been dropped from the buffer pool.
+         * @param frameId The frame to stop tracking.
+         */
+        virtual void remove(int frameId) = 0;
+};
+
+/**
+ * @brief BufferPool caches blocks of the disk in a bounded number of frames.
+ *
+ * A block is pinned while it is being used and cannot be evicted until it is unpinned. Blocks modified
+ * in their frame are marked dirty and written back to the disk when evicted or flushed. The number of
+ * hits, misses and blocks read and written give the real number of data block I/Os performed.
+ */
+class BufferPool {
+    public:
+
+        DiskAllocation* disk; ///< The disk whose blocks are cached.
+        int numFrames; ///< The number of frames in the buffer pool.
+        ReplacementPolicy policy; ///< The replacement policy used to evict frames.
+
+        // For Experiments
+        long long numHits; ///< The number of times a pinned block was already in a frame.
+        long long numMisses; ///< The number of times a pinned block had to be read into a frame.
+        long long numBlocksRead; ///< The number of blocks read from the disk.
+        long long numBlocksWritten; ///< The number of dirty blocks written back to the disk.
+        long long numEvictions; ///< The number of blocks evicted to make space for another block.
+
+        /**
+         * @brief Constructs a new BufferPool object.
+         * @param disk The disk whose blocks are cached.
+         * @param numFrames The number of frames in the buffer pool.
+         * @param policy The replacement policy used to evict frames.
+         */
+        BufferPool(DiskAllocation* disk, int numFrames, ReplacementPolicy policy);
+
+        /**
+         * @brief Destroys the BufferPool object, writing all dirty blocks back to the disk.
+         */
+        ~BufferPool();
+
+        /**
+         * @brief Pins a block in the buffer pool, reading it from the disk if it is not cached.
+         *
+         * The block is resolved from its ID into the frame holding it, which stays valid until the block is unpinned.
+         *
+         * @param blockId The ID of the block on the disk.
+         * @return The frame holding the content of the block.
+         * @throws runtime_error If every frame is pinned.
+         */
+        void* pinBlock(int blockId);
+
+        /**
+         * @brief Unpins a block previously pinned with pinBlock().
+         * @param blockId The ID of the block on the disk.
+         * @param isDirty Whether the content of the block was modified in its frame.
+         */
+        void unpinBlock(int blockId, bool isDirty);
+
+        /**
+         * @brief Drops a block from the buffer pool without writing it back, e.g. when the block is freed.
+         * @param blockId The ID of the block on the disk.
+         */
+        void discardBlock(int blockId);
+
+        /**
+         * @brief Writes all dirty blocks back to the disk.
+         */
+        void flushAll();
+
+        /**
+         * @brief Resets the hit, miss, read, write and eviction counters to zero.
+         */
+        void resetStatistics();
+
+    private:
+
+        /**
+         * @brief Struct to hold the state of a frame.
+         */
+        struct Frame {
+            int blockId; // -1 if the frame is free
+            int pinCount;
+            bool isDirty;
+        };
+
+        char* frameData; // content of all frames, blockSize bytes each
+        vector<Frame> frames;
+        list<int> freeFrames;
+        unordered_map<int, int> pageTable; // block ID to frame
+        Replacer* replacer;
+
+        /**
+         * @brief Writes the block held in a frame back to the disk if it is dirty.
+         * @param frameId The frame to write back.
+         */
+        void writeBack(int frameId);
+};
+
+#endif //PROJECT1_BUFFERPOOL_H
@@ -1,54 +1,579 @@
 #include "Database.h"
+#include "RangeFilter.h"
 #include "databaseStorage.h"
 #include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
 
 using namespace std;
+
+/**
+ * @brief Struct to describe where a column is found within a GameData record.
+ */
+struct ColumnInfo {
+    size_t offset;
+    size_t size;
+    const char* name;
+};
+
+// Position of each GameColumn within a GameData record
+static const ColumnInfo GAME_COLUMNS[NUM_GAME_COLUMNS] = {
+    {offsetof(GameData, GAME_DATE_EST), sizeof(GameData::GAME_DATE_EST), "GAME_DATE_EST"},
+    {offsetof(GameData, TEAM_ID_home), sizeof(GameData::TEAM_ID_home), "TEAM_ID_home"},
+    {offsetof(GameData, PTS_home), sizeof(GameData::PTS_home), "PTS_home"},
+    {offsetof(GameData, FG_PCT_home), sizeof(GameData::FG_PCT_home), "FG_PCT_home"},
+    {offsetof(GameData, FT_PCT_home), sizeof(GameData::FT_PCT_home), "FT_PCT_home"},
+    {offsetof(GameData, FG3_PCT_home), sizeof(GameData::FG3_PCT_home), "FG3_PCT_home"},
+    {offsetof(GameData, AST_home), sizeof(GameData::AST_home), "AST_home"},
+    {offsetof(GameData, REB_home), sizeof(GameData::REB_home), "REB_home"},
+    {offsetof(GameData, HOME_TEAM_WINS), sizeof(GameData::HOME_TEAM_WINS), "HOME_TEAM_WINS"},
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'D', 'S', 'P', 'P', 'S', 'N', 'A', 'P'};
+static const unsigned int SNAPSHOT_VERSION = 4;
+
+// Number of column values gathered before they are reduced by the aggregation kernel
+static const unsigned int AGGREGATE_BATCH_SIZE = 1024;
+
+// Relative costs of the access paths compared by planRangeQuery(), in sequential block reads
+static const double SEQUENTIAL_READ_COST = 1.0;
+static const double RANDOM_READ_COST = 4.0;
+static const double RECORD_CPU_COST = 0.01;
+
+/**
+ * @brief Struct to hold the partial aggregate of a worker of a parallel aggregation, on its own cache line.
+ */
+struct alignas(CACHE_LINE_SIZE) PartialAggregate {
+    AggregateResult result;
+    int numDataBlocksTouched = 0;
+};
 /**
  * @brief Constructs a new Database object with the specified disk and block sizes.
  *
  * This constructor initializes the database with the given disk size (in megabytes),
  * block size (in bytes), and maximum records per block. It also creates an empty virtual disk
- * and a B+ tree index structure.
+ * and a B+ tree index structure whose nodes are stored in blocks of the same disk.
  * @param diskSize The size of the virtual disk in megabytes (MB).
  * @param blockSize The size of each block in bytes.
+ * @param numFrames The number of frames of the buffer pool caching the data blocks.
+ * @param policy The replacement policy of the buffer pool.
+ * @param layout The layout of the records within a data block.
+ * @param aggregatedColumn The GameColumn whose COUNT and SUM are held in the B+ tree nodes, or -1 for none.
+ * @param layoutOfNodes The layout of the fields within a B+ tree node.
  */
-Database::Database(unsigned int diskSize, unsigned int blockSize)
+Database::Database(unsigned int diskSize, unsigned int blockSize, int numFrames, ReplacementPolicy policy, BlockLayout layout, int aggregatedColumn,
+                   NodeLayout layoutOfNodes)
 {
     DISK_SIZE = diskSize; // calculated in MB
     BLOCK_SIZE = blockSize; // calculated in B
-    MAX_RECORDS = (BLOCK_SIZE - sizeof(unsigned int))/(sizeof(GameData) + sizeof(indexMapping)); // maximum number of movieRecords for a block
+    blockLayout = layout;
+    setupBlockLayout(); // maximum number of movieRecords for a block
 
-    freeBlocks = {}; // Allows for tracking of blocks that can still accomodate additional records
     disk = new DiskAllocation(DISK_SIZE, BLOCK_SIZE);
-    bPlusTree = new BPlusTree(BLOCK_SIZE);
+    rebuildFreeSpaceMap(); // Allows for tracking of blocks that can still accomodate additional records
+    bufferPool = new BufferPool(disk, numFrames, policy);
+    aggregateColumn = aggregatedColumn;
+    nodeLayout = layoutOfNodes;
+    bPlusTree = new BPlusTree(BLOCK_SIZE, disk, aggregateColumn != -1, nodeLayout);
+    bPlusTree->payloadReader = [this](pointerBlockPair record) { return readPayload(record); };
+    numRecords = 0;
     numBlocks = 0;
+    initialBlockPtr = nullptr;
+    isConcurrent = false;
+    threadPool = nullptr;
+    numThreads = 0;
+}
+
+/**
+ * @brief Opens the Database stored in a file, or creates a new one in the file.
+ *
+ * This constructor maps the virtual disk stored in the given file into memory. The B+ tree
+ * nodes are stored in blocks of the same disk. If the file already holds a database, the
+ * state of the database and the root of its B+ tree are restored from the disk's superblock.
+ * @param filePath The path of the file holding the virtual disk.
+ * @param diskSize The size of the virtual disk in megabytes (MB), if it is created.
+ * @param blockSize The size of each block in bytes, if the disk is created.
+ * @param numFrames The number of frames of the buffer pool caching the data blocks.
+ * @param policy The replacement policy of the buffer pool.
+ * @param layout The layout of the records within a data block, if the disk is created.
+ * @param aggregatedColumn The GameColumn whose COUNT and SUM are held in the B+ tree nodes, or -1 for none, if the disk is created.
+ * @param layoutOfNodes The layout of the fields within a B+ tree node, if the disk is created.
+ */
+Database::Database(const string& filePath, unsigned int diskSize, unsigned int blockSize, int numFrames, ReplacementPolicy policy, BlockLayout layout, int aggregatedColumn,
+                   NodeLayout layoutOfNodes)
+{
+    disk = new DiskAllocation(filePath, diskSize, blockSize);
+    bufferPool = new BufferPool(disk, numFrames, policy);
+    DISK_SIZE = ((size_t)disk->numOfBlocks * disk->blockSize) / 1000000; // an existing disk keeps the size it was created with
+    BLOCK_SIZE = disk->blockSize;
+    blockLayout = disk->isReopened ? (BlockLayout)disk->superblock->blockLayout : layout; // an existing disk keeps its layout
+    setupBlockLayout();
+
+    aggregateColumn = disk->isReopened ? disk->superblock->aggregateColumn : aggregatedColumn; // the nodes of an existing tree keep their layout
+    nodeLayout = disk->isReopened ? (NodeLayout)disk->superblock->nodeLayout : layoutOfNodes;
+    bPlusTree = new BPlusTree(BLOCK_SIZE, disk, aggregateColumn != -1, nodeLayout);
+    bPlusTree->payloadReader = [this](pointerBlockPair record) { return readPayload(record); };
+    numRecords = 0;
+    numBlocks = 0;
+    initialBlockPtr = nullptr;
+    isConcurrent = false;
+    threadPool = nullptr;
+    numThreads = 0;
+
+    if (disk->isReopened) {
+        // Restore the state of the database and its B+ tree from the superblock
+        Superblock* superblock = disk->superblock;
+        numRecords = superblock->numRecords;
+        numBlocks = superblock->numDataBlocks;
+        if (superblock->initialBlockId != -1) {
+            initialBlockPtr = disk->fetchBlockAddress(superblock->initialBlockId);
+        }
+        bPlusTree->openExisting(bPlusTree->getNode({superblock->rootBlockId, -1}), superblock->height,
+                                superblock->numNodes, superblock->numOverflowNodes);
+    }
+    rebuildFreeSpaceMap();
 }
+
 /**
  * @brief Destructor for the Database class.
- * This destructor frees the allocated memory for the virtual disk and B+ tree index structure.
+ * This destructor frees the allocated memory for the virtual disk, buffer pool and B+ tree index structure.
+ * A file-backed database is synced to its file first.
  */
 Database::~Database() {
-    free(disk);
-    free(bPlusTree);
+    if (disk->isFileBacked) {
+        sync();
+    }
+    delete bufferPool; // writes back any remaining dirty data blocks
+    delete threadPool;
+    delete bPlusTree;
+    delete disk;
+}
+
+// The B+ tree latches its own nodes, while the data blocks and the buffer pool are shared behind a single latch
+/**
+ * @brief Lets several threads insert and retrieve records at the same time.
+ * @param optimisticReads Whether index lookups validate node versions instead of latching the nodes.
+ */
+void Database::enableConcurrency(bool optimisticReads)
+{
+    isConcurrent = true;
+    bPlusTree->enableConcurrency(optimisticReads);
+}
+
+// The workers are only started once a parallel scan needs them
+/**
+ * @brief Gets the worker threads running parallel scans, creating them on the first call.
+ * @return The thread pool.
+ */
+ThreadPool& Database::getThreadPool()
+{
+    lock_guard<mutex> poolLock(threadPoolLatch);
+    if (threadPool == nullptr) {
+        threadPool = new ThreadPool(numThreads);
+    }
+    return *threadPool;
+}
+
+// Works out how many records fit in a block, and where each column's minipage starts in the PAX layout
+/**
+ * @brief Sets MAX_RECORDS and the minipage offsets for the block layout of the database.
+ *
+ * In the NSM layout a block holds a DataBlockHeader, the indexMapping table and whole records.
+ * In the PAX layout the records are split into one minipage per column after the indexMapping table,
+ * each aligned to the size of its column so that its values are naturally aligned and contiguous. Minipages are not
+ * aligned to the vector width, so the SIMD kernels scanning them use unaligned loads.
+ */
+void Database::setupBlockLayout()
+{
+    if ((unsigned int)BLOCK_SIZE < MIN_BLOCK_SIZE) {
+        throw runtime_error("The block size is too small to hold a record.");
+    }
+    MAX_RECORDS = (BLOCK_SIZE - sizeof(DataBlockHeader))/(sizeof(GameData) + sizeof(indexMapping));
+    memset(columnOffsets, 0, sizeof(columnOffsets));
+    if (blockLayout != PAX) {
+        return;
+    }
+
+    // Padding between minipages may leave room for fewer records than the NSM layout
+    for (; MAX_RECORDS > 0; MAX_RECORDS--) {
+        size_t offset = sizeof(DataBlockHeader) + MAX_RECORDS*sizeof(indexMapping);
+        for (int column = 0; column < NUM_GAME_COLUMNS; column++) {
+            size_t size = GAME_COLUMNS[column].size;
+            offset = (offset + size - 1) / size * size;
+            columnOffsets[column] = offset;
+            offset += MAX_RECORDS*size;
+        }
+        if (offset <= (size_t)BLOCK_SIZE) {
+            return;
+        }
+    }
+    throw runtime_error("The block size is too small to hold a record.");
+}
+
+// Reads a record from the tail of an NSM block, or gathers it from the minipages of a PAX block
+/**
+ * @brief Reads a record from a data block.
+ * @param block The data block, or the buffer pool frame holding it.
+ * @param slot The index of the record in the block.
+ * @return The record.
+ */
+GameData Database::readRecord(void* block, int slot)
+{
+    GameData gameData;
+    if (blockLayout == PAX) {
+        for (int column = 0; column < NUM_GAME_COLUMNS; column++) {
+            size_t size = GAME_COLUMNS[column].size;
+            memcpy((char*)&gameData + GAME_COLUMNS[column].offset, (char*)block + columnOffsets[column] + slot*size, size);
+        }
+    } else {
+        GameData* tail = (GameData*)((char*)block + BLOCK_SIZE - sizeof(GameData)); // pointer to record slot at bottom of the block
+        gameData = *(tail - slot);
+    }
+    return gameData;
+}
+
+// Writes a record to the tail of an NSM block, or scatters it into the minipages of a PAX block
+/**
+ * @brief Writes a record into a data block.
+ * @param block The data block, or the buffer pool frame holding it.
+ * @param slot The index of the record in the block.
+ * @param gameData The record to write.
+ */
+void Database::writeRecord(void* block, int slot, const GameData& gameData)
+{
+    if (blockLayout == PAX) {
+        for (int column = 0; column < NUM_GAME_COLUMNS; column++) {
+            size_t size = GAME_COLUMNS[column].size;
+            memcpy((char*)block + columnOffsets[column] + slot*size, (const char*)&gameData + GAME_COLUMNS[column].offset, size);
+        }
+    } else {
+        GameData* tail = (GameData*)((char*)block + BLOCK_SIZE - sizeof(GameData));
+        *(tail - slot) = gameData;
+    }
+}
+
+// Reads a single column of a record as a double, without reading the rest of the record
+/**
+ * @brief Reads the value of a column of a record in a data block.
+ * @param block The data block, or the buffer pool frame holding it.
+ * @param slot The index of the record in the block.
+ * @param column The column to read.
+ * @return The value of the column.
+ */
+double Database::readColumnValue(void* block, int slot, GameColumn column)
+{
+    const char* field;
+    if (blockLayout == PAX) {
+        field = (char*)block + columnOffsets[column] + slot*GAME_COLUMNS[column].size;
+    } else {
+        field = (char*)block + BLOCK_SIZE - (slot + 1)*sizeof(GameData) + GAME_COLUMNS[column].offset;
+    }
+
+    switch (column) {
+        case GAME_DATE_EST_COLUMN: {
+            time_t value;
+            memcpy(&value, field, sizeof(value));
+            return (double)value;
+        }
+        case TEAM_ID_HOME_COLUMN: {
+            unsigned int value;
+            memcpy(&value, field, sizeof(value));
+            return value;
+        }
+        case FG_PCT_HOME_COLUMN:
+        case FT_PCT_HOME_COLUMN:
+        case FG3_PCT_HOME_COLUMN: {
+            float value;
+            memcpy(&value, field, sizeof(value));
+            return value;
+        }
+        default: {
+            unsigned short value;
+            memcpy(&value, field, sizeof(value));
+            return value;
+        }
+    }
+}
+
+/**
+ * @brief Reads the value of the column aggregated in the B+ tree nodes for a record, through the buffer pool.
+ * @param record The pointer-block pair of the record.
+ * @return The value of the aggregated column.
+ */
+double Database::readPayload(pointerBlockPair record)
+{
+    lock_guard<mutex> storageLock(storageLatch);
+    void* block = bufferPool->pinBlock(record.blockId);
+    double value = readColumnValue(block, (int)record.recordID, (GameColumn)aggregateColumn);
+    bufferPool->unpinBlock(record.blockId, false);
+    return value;
+}
+
+/**
+ * @brief Gets the name of a column.
+ * @param column The column.
+ * @return The name of the column, as in the imported data.
+ */
+const char* Database::getColumnName(GameColumn column)
+{
+    return GAME_COLUMNS[column].name;
+}
+
+/**
+ * @brief Gets the contiguous values of a column within a PAX data block.
+ * @param block The data block, or the buffer pool frame holding it.
+ * @param column The column to get.
+ * @return The start of the column's minipage, or nullptr if the blocks use the NSM layout.
+ */
+void* Database::getColumn(void* block, GameColumn column)
+{
+    if (blockLayout != PAX) {
+        return nullptr;
+    }
+    return (char*)block + columnOffsets[column];
+}
+
+/**
+ * @brief Writes the state of the database to the superblock of the disk.
+ *
+ * Dirty data blocks held by the buffer pool are written back first, and the root and statistics of the
+ * B+ tree are recorded. A file-backed disk is then flushed to its file.
+ */
+void Database::sync()
+{
+    bufferPool->flushAll();
+
+    Superblock* superblock = disk->superblock;
+    superblock->numRecords = numRecords;
+    superblock->numDataBlocks = numBlocks;
+    superblock->initialBlockId = (initialBlockPtr == nullptr) ? -1 : disk->fetchBlockId(initialBlockPtr);
+    superblock->blockLayout = blockLayout;
+    superblock->rootBlockId = bPlusTree->getNodeId(bPlusTree->root);
+    superblock->height = bPlusTree->height;
+    superblock->numNodes = bPlusTree->numNodes;
+    superblock->numOverflowNodes = bPlusTree->numOverflowNodes;
+    superblock->aggregateColumn = aggregateColumn;
+    superblock->nodeLayout = nodeLayout;
+    disk->sync();
+}
+
+// Writes the data blocks holding records and the B+ tree nodes, renumbering the references between the nodes
+/**
+ * @brief Saves the data blocks and the B+ tree of the database to a snapshot file.
+ *
+ * Dirty data blocks held by the buffer pool are written back first, so that the blocks can be copied
+ * straight from the disk. Each node is copied with its references to other nodes replaced by the index
+ * of the node they lead to, while its references to records keep the ID of their data block.
+ *
+ * @param path The path of the snapshot file, which is overwritten.
+ */
+void Database::saveSnapshot(const string& path)
+{
+    bufferPool->flushAll();
+
+    vector<int> blockIds;
+    for (int blockId = 0; blockId < disk->numOfBlocks; blockId++) {
+        if (disk->isRecordBlock(blockId)) {
+            blockIds.push_back(blockId);
+        }
+    }
+    vector<void*> nodes;
+    vector<NodeKind> nodeKinds;
+    bPlusTree->collectNodes(nodes, nodeKinds);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(SnapshotHeader));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.blockSize = BLOCK_SIZE;
+    header.blockLayout = blockLayout;
+    header.aggregateColumn = aggregateColumn;
+    header.nodeLayout = nodeLayout;
+    header.numRecords = numRecords;
+    header.numDataBlocks = numBlocks;
+    header.initialBlockId = (initialBlockPtr == nullptr) ? -1 : disk->fetchBlockId(initialBlockPtr);
+    header.numSavedBlocks = blockIds.size();
+    header.maxKeys = bPlusTree->maxKeys;
+    header.height = bPlusTree->height;
+    header.numNodes = bPlusTree->numNodes;
+    header.numOverflowNodes = bPlusTree->numOverflowNodes;
+    header.numSavedNodes = nodes.size();
+
+    // Copy the blocks and the swizzled nodes into one buffer each, so that they are written sequentially
+    vector<char> blockImages((size_t)blockIds.size()*BLOCK_SIZE);
+    for (size_t i = 0; i < blockIds.size(); i++) {
+        memcpy(blockImages.data() + i*BLOCK_SIZE, disk->fetchBlockAddress(blockIds[i]), BLOCK_SIZE);
+    }
+    unordered_map<int, unsigned int> nodeIndexes;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        nodeIndexes[bPlusTree->getNodeId(nodes[i])] = i;
+    }
+    vector<unsigned char> kinds(nodeKinds.begin(), nodeKinds.end());
+    vector<char> nodeImages((size_t)nodes.size()*bPlusTree->sizeOfNode);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bPlusTree->saveNodeImage(nodes[i], nodeKinds[i], nodeIndexes, nodeImages.data() + i*bPlusTree->sizeOfNode);
+    }
+
+    ofstream snapshot(path, ios::binary | ios::trunc);
+    if (!snapshot.is_open()) {
+        throw runtime_error("Unable to open the snapshot file " + path + ".");
+    }
+    snapshot.write((const char*)&header, sizeof(SnapshotHeader));
+    snapshot.write((const char*)blockIds.data(), blockIds.size()*sizeof(int));
+    snapshot.write(blockImages.data(), blockImages.size());
+    snapshot.write((const char*)kinds.data(), kinds.size());
+    snapshot.write(nodeImages.data(), nodeImages.size());
+    snapshot.close();
+    if (snapshot.fail()) {
+        throw runtime_error("Unable to write the snapshot file " + path + ".");
+    }
+}
+
+// Reads the data blocks and the B+ tree nodes into newly allocated blocks and nodes, then renumbers the references of the nodes
+/**
+ * @brief Loads the data blocks and the B+ tree saved in a snapshot file into this empty database.
+ *
+ * Each saved data block is copied into an unused block of the disk, and each saved node into a new node of
+ * the B+ tree. The references held by the nodes are then turned into the IDs of those blocks and nodes.
+ *
+ * @param path The path of the snapshot file.
+ */
+void Database::loadSnapshot(const string& path)
+{
+    if (numRecords != 0 || numBlocks != 0) {
+        throw runtime_error("A snapshot can only be loaded into an empty database.");
+    }
+
+    ifstream snapshot(path, ios::binary);
+    if (!snapshot.is_open()) {
+        throw runtime_error("Unable to open the snapshot file " + path + ".");
+    }
+    SnapshotHeader header;
+    if (!snapshot.read((char*)&header, sizeof(SnapshotHeader))
+        || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != SNAPSHOT_VERSION) {
+        throw runtime_error(path + " does not hold a valid snapshot.");
+    }
+    if (header.blockSize != (unsigned int)BLOCK_SIZE) {
+        throw runtime_error(path + " was saved with a block size of " + to_string(header.blockSize) + "B.");
+    }
+    if ((int)header.numSavedBlocks > disk->numOfUnusedBlocks) {
+        throw runtime_error("The disk is too small to hold the snapshot " + path + ".");
+    }
+
+    // Take on the block layout and the node layout of the snapshot
+    blockLayout = (BlockLayout)header.blockLayout;
+    setupBlockLayout();
+    if (header.aggregateColumn != aggregateColumn || header.nodeLayout != (unsigned int)nodeLayout) {
+        bool optimisticReads = bPlusTree->isOptimistic;
+        bPlusTree->freeNode(bPlusTree->root); // release the empty root of the tree being replaced
+        delete bPlusTree;
+        aggregateColumn = header.aggregateColumn;
+        nodeLayout = (NodeLayout)header.nodeLayout;
+        bPlusTree = new BPlusTree(BLOCK_SIZE, disk, aggregateColumn != -1, nodeLayout);
+        bPlusTree->payloadReader = [this](pointerBlockPair record) { return readPayload(record); };
+        if (isConcurrent) {
+            bPlusTree->enableConcurrency(optimisticReads);
+        }
+    }
+    if (header.maxKeys != bPlusTree->maxKeys) {
+        throw runtime_error(path + " holds B+ tree nodes of a different layout.");
+    }
+
+    vector<int> blockIds(header.numSavedBlocks);
+    vector<char> blockImages((size_t)header.numSavedBlocks*BLOCK_SIZE);
+    vector<unsigned char> kinds(header.numSavedNodes);
+    vector<char> nodeImages((size_t)header.numSavedNodes*bPlusTree->sizeOfNode);
+    if (!snapshot.read((char*)blockIds.data(), blockIds.size()*sizeof(int))
+        || !snapshot.read(blockImages.data(), blockImages.size())
+        || !snapshot.read((char*)kinds.data(), kinds.size())
+        || !snapshot.read(nodeImages.data(), nodeImages.size())
+        || header.numSavedNodes == 0) {
+        throw runtime_error(path + " is incomplete.");
+    }
+    for (unsigned char kind : kinds) {
+        if (kind > OVERFLOW_NODE) {
+            throw runtime_error(path + " does not hold a valid snapshot.");
+        }
+    }
+
+    // Copy the data blocks into unused blocks of the disk
+    unordered_map<int, int> dataBlockIds;
+    for (size_t i = 0; i < blockIds.size(); i++) {
+        void* blockAddress = disk->getUnusedBlock();
+        memcpy(blockAddress, blockImages.data() + i*BLOCK_SIZE, BLOCK_SIZE);
+        disk->setRecordBlock(blockAddress, true);
+        dataBlockIds[blockIds[i]] = disk->fetchBlockId(blockAddress);
+    }
+
+    // Copy the nodes into new nodes, then point them at each other and at the data blocks
+    vector<int> nodeBlockIds(header.numSavedNodes);
+    for (size_t i = 0; i < nodeBlockIds.size(); i++) {
+        void* node = bPlusTree->getNewNode(kinds[i] != NON_LEAF_NODE, kinds[i] == OVERFLOW_NODE);
+        memcpy(node, nodeImages.data() + i*bPlusTree->sizeOfNode, bPlusTree->sizeOfNode);
+        nodeBlockIds[i] = bPlusTree->getNodeId(node);
+    }
+    for (size_t i = 0; i < nodeBlockIds.size(); i++) {
+        bPlusTree->loadNodeImage(bPlusTree->getNode({nodeBlockIds[i], -1}), (NodeKind)kinds[i], nodeBlockIds, dataBlockIds);
+    }
+    bPlusTree->openExisting(bPlusTree->getNode({nodeBlockIds[0], -1}), header.height, header.numNodes, header.numOverflowNodes);
+
+    numRecords = header.numRecords;
+    numBlocks = header.numDataBlocks;
+    auto initialBlock = dataBlockIds.find(header.initialBlockId);
+    initialBlockPtr = (initialBlock == dataBlockIds.end()) ? nullptr : disk->fetchBlockAddress(initialBlock->second);
+    rebuildFreeSpaceMap();
+}
+
+// Buckets each data block by its number of free slots, reading the block headers straight from the disk
+/**
+ * @brief Rebuilds the free-space map from the headers of the data blocks on the disk.
+ *
+ * Bucket k of the map holds the IDs of the data blocks with k free slots, so full blocks are left out.
+ * The map is not stored on the disk, as it is cheap to rebuild when a database is reopened or loaded.
+ */
+void Database::rebuildFreeSpaceMap()
+{
+    freeSpaceMap.assign(MAX_RECORDS + 1, {});
+    for (int blockId = 0; blockId < disk->numOfBlocks; blockId++) {
+        if (disk->isRecordBlock(blockId)) {
+            DataBlockHeader* header = (DataBlockHeader*)disk->fetchBlockAddress(blockId);
+            unsigned int numFreeSlots = MAX_RECORDS - header->numRecords;
+            if (numFreeSlots > 0) {
+                freeSpaceMap[numFreeSlots].insert(blockId);
+            }
+        }
+    }
 }
 
 /**
  * @brief Imports data from an external source into the database.
- * This method retrieves data records from an external source (e.g., a file) using the
- * `databaseStorage` class and inserts them into the database. It keeps track of the number
- * of records inserted.
+ * This method pulls data records in batches from an external source (e.g., a file) using a
+ * `RecordStream` and stores them into the database while the next batch is being parsed. The B+ tree
+ * index is then bulk loaded from all stored records at once. It keeps track of the number of records inserted.
+ * @param fillFactor The fraction (0, 1] of each B+ tree node to fill when building the index.
  */
-void Database::importData(){
+void Database::importData(float fillFactor){
 
-    databaseStorage dbStorage;
-    vector<GameData> data = dbStorage.getDatabaseRecord();
+    RecordStream recordStream;
+    vector<GameData> batch;
     this->numRecords = 0;
-    // Loop over the data and insert all the movie records
-    for (auto gamedata_address = data.begin(); gamedata_address != data.end(); ++gamedata_address)
+
+    vector<pair<float, pointerBlockPair>> indexEntries;
+
+    // Loop over the batches and store all the game records, keeping their keys for the index
+    while (recordStream.nextBatch(batch))
     {
-        insertRecord(*gamedata_address);
-        this->numRecords++;
+        for (auto gamedata_address = batch.begin(); gamedata_address != batch.end(); ++gamedata_address)
+        {
+            indexEntries.push_back({gamedata_address->FG_PCT_home, storeRecord(*gamedata_address)});
+        }
     } //close for loop
+
+    // Build the B+ Tree over all the stored records in one pass
+    bPlusTree->bulkLoad(indexEntries, fillFactor);
     cout << "Data has been successfully imported" << endl;
 
 
@@ -64,74 +589,597 @@ void Database::importData(){
  * @param gameData The GameData record to be inserted into the database.
  */
 void Database::insertRecord(GameData gameData)
+{
+    pointerBlockPair record;
+    {
+        lock_guard<mutex> storageLock(storageLatch);
+        record = storeRecord(gameData);
+    }
+
+    // Update B+ Tree with new record inserted
+    bPlusTree->insertRecord(gameData.FG_PCT_home, record);
+}
+
+// Stores a movieRecord into a data block without updating the B+ Tree
+/**
+ * @brief Stores a GameData record into a data block.
+ *
+ * This method manages block allocation, record insertion and index mapping for a new
+ * GameData record. The data block is modified in its buffer pool frame. The B+ Tree index is not updated.
+ *
+ * @param gameData The GameData record to be stored.
+ * @return The pointer-block pair referencing the stored record.
+ */
+pointerBlockPair Database::storeRecord(GameData gameData)
 {
     // note that checking if record is already inserted should be done in the B+ tree implementation
-    void* blockAddress;
     void* blockToInsert;
-    unsigned int* numRecords;
-    indexMapping* indexMappingTable;
+    int blockId = -1;
 
-    //Retrieve a block for insertion of record, get new block from disk if all blocks are fully filled
-    if (freeBlocks.size() == 0) {
+    // Retrieve the block with the fewest free slots, so that partially empty blocks are refilled before new ones are used
+    unsigned int numFreeSlots = 1;
+    for (; numFreeSlots <= (unsigned int)MAX_RECORDS; numFreeSlots++) {
+        if (!freeSpaceMap[numFreeSlots].empty()) {
+            blockId = *freeSpaceMap[numFreeSlots].begin();
+            freeSpaceMap[numFreeSlots].erase(blockId);
+            break;
+        }
+    }
+
+    DataBlockHeader* header;
+    if (blockId == -1) {
         // no free blocks, get a new one and initialize header information
-        blockAddress = disk->getUnusedBlock();
-        disk->updateMapTable(blockAddress);
+        void* blockAddress = disk->getUnusedBlock();
+        if (blockAddress == nullptr) {
+            throw runtime_error("No unused blocks left on the disk.");
+        }
+        disk->setRecordBlock(blockAddress, true);
         numBlocks++;
-        freeBlocks.push_front(blockAddress);
-        blockToInsert = blockAddress;
-        numRecords = (unsigned int*)blockToInsert;
-        *numRecords = 0; // initialize first 4 bytes to be 0
+        if (initialBlockPtr == nullptr)    initialBlockPtr = blockAddress;
+
+        blockId = disk->fetchBlockId(blockAddress);
+        blockToInsert = bufferPool->pinBlock(blockId);
+        header = (DataBlockHeader*)blockToInsert;
+        *header = {0, 0, -1};
+        numFreeSlots = MAX_RECORDS;
     }
     else {
-        blockAddress = freeBlocks.front();
-        blockToInsert = blockAddress;
-        numRecords = (unsigned int*)blockToInsert;
+        blockToInsert = bufferPool->pinBlock(blockId);
+        header = (DataBlockHeader*)blockToInsert;
     }
 
-    if(initialBlockPtr==nullptr)    initialBlockPtr = blockToInsert;
+    indexMapping* indexMappingTable = (indexMapping*)(header + 1); // pointer to start of indexMapping table, starts directly after the header
 
-    indexMappingTable = (indexMapping*)(numRecords + 1); // pointer to start of indexMapping table, starts directly after numRecords
-    GameData* tail = (GameData*)((char*)blockToInsert + BLOCK_SIZE - sizeof(GameData)); // pointer to record slot at bottom of the block
+    // Take the slot at the head of the free-slot chain, or else the first slot that has never been used
+    // In the NSM layout, records are inserted starting from the back of the block
+    int index;
+    if (header->freeSlotHead != -1) {
+        index = header->freeSlotHead;
+        header->freeSlotHead = (int)indexMappingTable[index].key;
+    } else {
+        index = header->numSlots++;
+    }
 
-    // Setting insertRecordPointer to point to the space for insertion of record
-    // Records are inserted starting from the back of the block
-    GameData* insertRecordPointer = tail - *numRecords;
-    indexMapping* insertindexMappingPointer = indexMappingTable + *numRecords;
+    // Insert record to disk
+    writeRecord(blockToInsert, index, gameData); // insert record data
+    indexMappingTable[index] = {gameData.FG_PCT_home, index}; // insert new indexMapping table entry
+    header->numRecords++;
+    numRecords++;
 
-    // Search for gravestones which indicate free spaces within the blocks for record insertion
-    int numGravestones = 0;
-    int index = *numRecords;
-    for(unsigned int i = 0; i<*numRecords; i++)
-    {
-        if ((indexMappingTable + i)->indexOfRecord == -1)
-        {
-            // Replace last gravestone
-            insertRecordPointer = tail - i;
-            insertindexMappingPointer = indexMappingTable + i;
-            index = i;
-            numGravestones++;
+    // Move the block down a bucket of the free-space map, leaving it out once it cannot hold any more records
+    if (numFreeSlots > 1) {
+        freeSpaceMap[numFreeSlots - 1].insert(blockId);
+    }
+
+    bufferPool->unpinBlock(blockId, true);
+    return {blockId, (float) index};
+}
+
+// Deletes a record from its data block, leaving a gravestone that heads the free-slot chain of the block
+/**
+ * @brief Deletes a record from its data block.
+ *
+ * The indexMapping entry of the record becomes a gravestone linking to the previous head of the free-slot
+ * chain, and the block moves up a bucket of the free-space map. The B+ Tree index is not updated.
+ *
+ * @param record The pointer-block pair of the record to delete.
+ */
+void Database::deleteRecord(pointerBlockPair record)
+{
+    void* block = bufferPool->pinBlock(record.blockId);
+    DataBlockHeader* header = (DataBlockHeader*)block;
+    indexMapping* indexMappingTable = (indexMapping*)(header + 1);
+    int slot = (int)record.recordID;
+    if (slot < 0 || slot >= (int)header->numSlots || indexMappingTable[slot].indexOfRecord == -1) {
+        bufferPool->unpinBlock(record.blockId, false);
+        throw runtime_error("Slot " + to_string(slot) + " of block " + to_string(record.blockId) + " does not hold a record.");
+    }
+
+    unsigned int numFreeSlots = MAX_RECORDS - header->numRecords;
+    indexMappingTable[slot] = {(float)header->freeSlotHead, -1};
+    header->freeSlotHead = slot;
+    header->numRecords--;
+    numRecords--;
+
+    if (numFreeSlots > 0) {
+        freeSpaceMap[numFreeSlots].erase(record.blockId);
+    }
+    if (header->numRecords > 0) {
+        freeSpaceMap[numFreeSlots + 1].insert(record.blockId);
+        bufferPool->unpinBlock(record.blockId, true);
+        return;
+    }
+
+    // Return the emptied block to the disk, dropping it from the buffer pool without writing it back
+    bufferPool->unpinBlock(record.blockId, false);
+    bufferPool->discardBlock(record.blockId);
+    void* blockAddress = disk->fetchBlockAddress(record.blockId);
+    disk->updateMapTable(blockAddress);
+    numBlocks--;
+    if (initialBlockPtr == blockAddress) {
+        // The next block holding records becomes the initial block
+        initialBlockPtr = nullptr;
+        for (int blockId = record.blockId + 1; blockId < disk->numOfBlocks && initialBlockPtr == nullptr; blockId++) {
+            if (disk->isRecordBlock(blockId)) {
+                initialBlockPtr = disk->fetchBlockAddress(blockId);
+            }
         }
     }
+}
 
-    if (numGravestones > 0)
-    {
-        numGravestones--; // revive a single gravestone
-        (*numRecords)--; // to keep numRecords unchanged when it is incremented later
+// Deletes the records of a range from the B+ Tree and from their data blocks, and reports the storage reclaimed
+/**
+ * @brief Deletes the records whose key lies within a range from the database.
+ *
+ * The keys are removed from the B+ Tree first, which hands back the records they pointed to. Each record is
+ * then deleted from its data block, and blocks left empty are returned to the disk. The storage reclaimed is
+ * the data blocks returned to the disk and the blocks of the B+ Tree nodes put on the free list of the node pool, plus the slots freed in the data
+ * blocks that still hold records, which new records reuse through the free-slot chains.
+ *
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param output The output file stream to write the statistics to.
+ * @return The number of records deleted.
+ */
+int Database::deleteRecords(float pointsHomeStart, float pointsHomeEnd, ofstream &output)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    int numNodesBefore = bPlusTree->numNodes + bPlusTree->numOverflowNodes;
+
+    list<pointerBlockPair> records = bPlusTree->deleteRange(pointsHomeStart, pointsHomeEnd);
+    lock_guard<mutex> storageLock(storageLatch);
+    for (const pointerBlockPair& record : records) {
+        deleteRecord(record);
     }
 
-    // Insert record to disk
-    *insertRecordPointer = gameData; // insert record data
-    *insertindexMappingPointer = {gameData.FG_PCT_home, index}; // insert new indexMapping table entry
-    (*numRecords)++;
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
 
-    // Update B+ Tree with new record inserted
-    bPlusTree->insertRecord(gameData.FG_PCT_home, {blockAddress, gameData.FG_PCT_home});
+    if (output.is_open()) {
+        int numNodesFreed = numNodesBefore - (bPlusTree->numNodes + bPlusTree->numOverflowNodes);
+        // The blocks freed are counted from the records deleted rather than from numBlocks, which concurrent
+        // inserts change before storageLatch is taken. The slots of records deleted from blocks still holding
+        // records are reused through their free-slot chains
+        unordered_set<int> blocksFreed;
+        long long numSlotsFreed = 0;
+        for (const pointerBlockPair& record : records) {
+            if (disk->isRecordBlock(record.blockId)) {
+                numSlotsFreed++;
+            } else {
+                blocksFreed.insert(record.blockId);
+            }
+        }
+        int numBlocksFreed = (int)blocksFreed.size();
+        output << "Number of records deleted: " << records.size() << "\n";
+        output << "Number of data blocks freed: " << numBlocksFreed << "\n";
+        output << "Number of record slots freed in the remaining data blocks: " << numSlotsFreed << "\n";
+        output << "Number of B+ tree nodes freed: " << numNodesFreed << "\n";
+        output << "Storage reclaimed: " << (long long)(numBlocksFreed + numNodesFreed)*BLOCK_SIZE
+                                            + numSlotsFreed*(long long)(sizeof(GameData) + sizeof(indexMapping)) << " bytes\n";
+        output << "Number of nodes of the updated B+ tree: " << bPlusTree->numNodes << "\n";
+        output << "Number of levels of the updated B+ tree: " << bPlusTree->height+1 << "\n";
+        output << "Content of the root node of the updated B+ tree:";
+        NodeHeader* rootHeader = (NodeHeader*)bPlusTree->root;
+        float* rootKeys = bPlusTree->getKeys(bPlusTree->root);
+        for (unsigned int i = 0; i < rootHeader->numKeys; i++) {
+            output << " " << rootKeys[i];
+        }
+        output << "\n";
+        output << "Running time of the process: " << elapsedTime.count() << " microseconds \n";
+    }
+    return records.size();
+}
 
-    // Remove block from list of freeblocks if updated block cannot hold any more records
-    if (*numRecords == MAX_RECORDS && numGravestones == 0)
-    {
-        freeBlocks.pop_front();
+// Retrieves the records of a range query, pinning the data block of each record in the buffer pool
+/**
+ * @brief Retrieves the records whose key lies within a range through the buffer pool.
+ *
+ * The records are located with the B+ tree, and the data block holding each record is pinned in the
+ * buffer pool while the record is copied out of it. The buffer pool statistics are reset beforehand,
+ * so the hits and misses reported only account for this retrieval.
+ *
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param output The output file stream to write the statistics to.
+ * @return The records found.
+ */
+vector<GameData> Database::retrieveRecords(float pointsHomeStart, float pointsHomeEnd, ofstream &output)
+{
+    ofstream noOutput; // the index lookup statistics are not written again
+    list<pointerBlockPair> results = bPlusTree->findRecord(pointsHomeStart, pointsHomeEnd, noOutput);
+
+    lock_guard<mutex> storageLock(storageLatch);
+    bufferPool->resetStatistics();
+    vector<GameData> records;
+    records.reserve(results.size());
+    for (const pointerBlockPair& result : results) {
+        void* block = bufferPool->pinBlock(result.blockId);
+        records.push_back(readRecord(block, (int)result.recordID));
+        bufferPool->unpinBlock(result.blockId, false);
+    }
+
+    if (output.is_open()) {
+        output << "Buffer pool hits: " << bufferPool->numHits << ", misses: " << bufferPool->numMisses
+               << " (" << bufferPool->numFrames << " frames)\n";
+        output << "Total number of data blocks read from disk: " << bufferPool->numBlocksRead << "\n";
+    }
+    return records;
+}
+
+// Aggregates a column over the records of a range query, visiting each data block once
+/**
+ * @brief Computes the COUNT, SUM, AVG, MIN and MAX of a column over the records whose key lies within a range.
+ *
+ * The records are located with the B+ tree and sorted by data block, so each block holding a matching record
+ * is pinned in the buffer pool only once. The values of the column are gathered into batches which are reduced
+ * by the SIMD kernel of Aggregation.
+ *
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param column The column to aggregate.
+ * @param output The output file stream to write the aggregates and statistics to.
+ * @return The aggregates of the column.
+ */
+AggregateResult Database::aggregate(float pointsHomeStart, float pointsHomeEnd, GameColumn column, ofstream &output)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    ofstream noOutput; // the index lookup statistics are not written again
+    list<pointerBlockPair> found = bPlusTree->findRecord(pointsHomeStart, pointsHomeEnd, noOutput);
+
+    // Group the records by data block
+    vector<pointerBlockPair> records(found.begin(), found.end());
+    sort(records.begin(), records.end(), [](const pointerBlockPair& a, const pointerBlockPair& b) {
+        return a.blockId < b.blockId || (a.blockId == b.blockId && a.recordID < b.recordID);
+    });
+
+    lock_guard<mutex> storageLock(storageLatch);
+    bufferPool->resetStatistics();
+    AggregateResult result;
+    vector<double> batch;
+    batch.reserve(AGGREGATE_BATCH_SIZE);
+    int numDataBlocksTouched = 0;
+
+    size_t i = 0;
+    while (i < records.size()) {
+        int blockId = records[i].blockId;
+        void* block = bufferPool->pinBlock(blockId);
+        numDataBlocksTouched++;
+        for (; i < records.size() && records[i].blockId == blockId; i++) {
+            batch.push_back(readColumnValue(block, (int)records[i].recordID, column));
+            if (batch.size() == AGGREGATE_BATCH_SIZE) {
+                Aggregation::accumulate(batch.data(), batch.size(), result);
+                batch.clear();
+            }
+        }
+        bufferPool->unpinBlock(blockId, false);
+    }
+    Aggregation::accumulate(batch.data(), batch.size(), result);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    if (output.is_open()) {
+        const char* name = getColumnName(column);
+        output << "Total number of data blocks touched by aggregation: " << numDataBlocksTouched << "\n";
+        output << "Count of " << name << ": " << result.count << "\n";
+        output << "Sum of " << name << ": " << result.sum << "\n";
+        output << "Minimum of " << name << ": " << result.min << "\n";
+        output << "Maximum of " << name << ": " << result.max << "\n";
+        output << "Average of " << name << ": " << result.avg() << "\n";
+        output << "Running time for Aggregation: " << elapsedTime.count() << " microseconds \n";
+    }
+    return result;
+}
+
+// The index is scanned first without holding storageLatch, as inserts into a tree with aggregates read data blocks while holding node latches
+// The morsels are then aggregated on the workers, each worker accumulating into its own partial aggregate
+// The thread pool is held across both batches, so that storageLatch is always taken after it
+/**
+ * @brief Computes the COUNT, SUM, AVG, MIN and MAX of a column over a key range on every worker of threadPool.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param column The column to aggregate.
+ * @param output The output file stream to write the aggregates and statistics to.
+ * @return The aggregates of the column.
+ */
+AggregateResult Database::aggregateParallel(float pointsHomeStart, float pointsHomeEnd, GameColumn column, ofstream &output)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ThreadPool& pool = getThreadPool();
+    lock_guard<recursive_mutex> poolLock(pool.runLatch);
+
+    // Find the records of each morsel, grouped by data block
+    vector<vector<pointerBlockPair>> morselRecords(pool.numThreads * MORSELS_PER_THREAD);
+    size_t numMorsels = bPlusTree->scanParallel(pointsHomeStart, pointsHomeEnd, pool,
+                                                [&](size_t morsel, unsigned int, list<pointerBlockPair>& found) {
+        vector<pointerBlockPair>& records = morselRecords[morsel];
+        records.assign(found.begin(), found.end());
+        sort(records.begin(), records.end(), [](const pointerBlockPair& a, const pointerBlockPair& b) {
+            return a.blockId < b.blockId || (a.blockId == b.blockId && a.recordID < b.recordID);
+        });
+    });
+
+    lock_guard<mutex> storageLock(storageLatch);
+    bufferPool->flushAll();
+    vector<PartialAggregate> partials(pool.numThreads);
+    pool.run(numMorsels, [&](size_t morsel, unsigned int worker) {
+        const vector<pointerBlockPair>& records = morselRecords[morsel];
+        PartialAggregate& partial = partials[worker];
+        vector<double> batch;
+        batch.reserve(AGGREGATE_BATCH_SIZE);
+        size_t i = 0;
+        while (i < records.size()) {
+            int blockId = records[i].blockId;
+            void* block = disk->fetchBlockAddress(blockId);
+            partial.numDataBlocksTouched++;
+            for (; i < records.size() && records[i].blockId == blockId; i++) {
+                batch.push_back(readColumnValue(block, (int)records[i].recordID, column));
+                if (batch.size() == AGGREGATE_BATCH_SIZE) {
+                    Aggregation::accumulate(batch.data(), batch.size(), partial.result);
+                    batch.clear();
+                }
+            }
+        }
+        Aggregation::accumulate(batch.data(), batch.size(), partial.result);
+    });
+
+    // Merge the partial aggregates of the workers
+    AggregateResult result;
+    int numDataBlocksTouched = 0;
+    for (const PartialAggregate& partial : partials) {
+        Aggregation::merge(partial.result, result);
+        numDataBlocksTouched += partial.numDataBlocksTouched;
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    if (output.is_open()) {
+        const char* name = getColumnName(column);
+        output << "Parallel aggregation of " << numMorsels << " morsels on " << pool.numThreads << " threads\n";
+        output << "Total number of data blocks touched by parallel aggregation: " << numDataBlocksTouched << "\n";
+        output << "Count of " << name << ": " << result.count << "\n";
+        output << "Sum of " << name << ": " << result.sum << "\n";
+        output << "Minimum of " << name << ": " << result.min << "\n";
+        output << "Maximum of " << name << ": " << result.max << "\n";
+        output << "Average of " << name << ": " << result.avg() << "\n";
+        output << "Running time for Parallel Aggregation: " << elapsedTime.count() << " microseconds \n";
+    }
+    return result;
+}
+
+// A brute force scan: every slot of every data block is tested, whatever the width of the range
+// The key column of an NSM block is first gathered from its records, so that both layouts are filtered from a contiguous array
+/**
+ * @brief Retrieves the records whose key lies within a range by scanning every data block, without the B+ tree.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param output The output file stream to write the statistics to.
+ * @return The records found, in the order of their data blocks.
+ */
+vector<GameData> Database::linearScan(float pointsHomeStart, float pointsHomeEnd, ofstream &output)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ThreadPool& pool = getThreadPool();
+    lock_guard<recursive_mutex> poolLock(pool.runLatch);
+    lock_guard<mutex> storageLock(storageLatch);
+    bufferPool->flushAll();
+
+    // List the data blocks, skipping the words of the record bitmap without any
+    vector<int> blockIds;
+    for (int word = 0; word < (disk->numOfBlocks + 63) / 64; word++) {
+        for (uint64_t bits = disk->recordMap[word]; bits != 0; bits &= bits - 1) {
+            blockIds.push_back(word * 64 + __builtin_ctzll(bits));
+        }
+    }
+
+    // Each morsel is a run of adjacent data blocks
+    size_t numMorsels = min<size_t>(blockIds.size(), pool.numThreads * MORSELS_PER_THREAD);
+    vector<vector<GameData>> morselRecords(numMorsels);
+    pool.run(numMorsels, [&](size_t morsel, unsigned int) {
+        vector<float> keys(MAX_RECORDS);
+        vector<unsigned int> selected(MAX_RECORDS);
+        for (size_t b = blockIds.size() * morsel / numMorsels; b < blockIds.size() * (morsel + 1) / numMorsels; b++) {
+            void* block = disk->fetchBlockAddress(blockIds[b]);
+            DataBlockHeader* header = (DataBlockHeader*)block;
+            indexMapping* mapping = (indexMapping*)(header + 1);
+            const float* keyColumn = (const float*)getColumn(block, FG_PCT_HOME_COLUMN);
+            if (keyColumn == nullptr) {
+                GameData* tail = (GameData*)((char*)block + BLOCK_SIZE - sizeof(GameData));
+                for (unsigned int slot = 0; slot < header->numSlots; slot++) {
+                    keys[slot] = (tail - slot)->FG_PCT_home;
+                }
+                keyColumn = keys.data();
+            }
+
+            // The free slots still hold the values of the records deleted from them
+            unsigned int numSelected = RangeFilter::select(keyColumn, header->numSlots, pointsHomeStart, pointsHomeEnd, selected.data());
+            for (unsigned int i = 0; i < numSelected; i++) {
+                if (mapping[selected[i]].indexOfRecord != -1) {
+                    morselRecords[morsel].push_back(readRecord(block, selected[i]));
+                }
+            }
+        }
+    });
+
+    vector<GameData> records;
+    for (vector<GameData>& morsel : morselRecords) {
+        records.insert(records.end(), morsel.begin(), morsel.end());
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    if (output.is_open()) {
+        output << "Running time for Brute Force Linear Scan: " << elapsedTime.count() << " microseconds \n";
+        output << "Total number of data block accessed (during linear scan): " << blockIds.size() << "\n";
+        output << "Number of records found by linear scan: " << records.size() << " (" << numMorsels << " morsels on "
+               << pool.numThreads << " threads, " << RangeFilter::getKernelName() << " filter)\n";
+    }
+    return records;
+}
+
+/**
+ * @brief Retrieves the records whose key lies within a range, fetching each data block holding them once.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param output The output file stream to write the statistics to.
+ * @return The records found, in the order of their data blocks.
+ */
+vector<GameData> Database::retrieveRecordsByBlock(float pointsHomeStart, float pointsHomeEnd, ofstream &output)
+{
+    ofstream noOutput; // the index lookup statistics are not written again
+    list<pointerBlockPair> found = bPlusTree->findRecord(pointsHomeStart, pointsHomeEnd, noOutput);
+    vector<pointerBlockPair> results(found.begin(), found.end());
+    sort(results.begin(), results.end(), [](const pointerBlockPair& a, const pointerBlockPair& b) {
+        return a.blockId < b.blockId || (a.blockId == b.blockId && a.recordID < b.recordID);
+    });
+
+    lock_guard<mutex> storageLock(storageLatch);
+    bufferPool->resetStatistics();
+    vector<GameData> records;
+    records.reserve(results.size());
+    size_t i = 0;
+    while (i < results.size()) {
+        int blockId = results[i].blockId;
+        void* block = bufferPool->pinBlock(blockId);
+        for (; i < results.size() && results[i].blockId == blockId; i++) {
+            records.push_back(readRecord(block, (int)results[i].recordID));
+        }
+        bufferPool->unpinBlock(blockId, false);
+    }
+
+    if (output.is_open()) {
+        output << "Buffer pool hits: " << bufferPool->numHits << ", misses: " << bufferPool->numMisses
+               << " (" << bufferPool->numFrames << " frames)\n";
+        output << "Total number of data blocks read from disk: " << bufferPool->numBlocksRead << "\n";
     }
+    return records;
+}
+
+// Every access path pays for its block reads, and the index scans also for descending the B+ tree and walking its leaves
+// Costs are the total work of each path, so the full scan is not made cheaper by the workers it happens to run on
+// Blocks read in increasing order get cheaper as they get denser, down to a sequential read when every block is read
+/**
+ * @brief Chooses the cheapest access path to retrieve the records whose key lies within a range.
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @return The plan, with the cost of every access path.
+ */
+QueryPlan Database::planRangeQuery(float pointsHomeStart, float pointsHomeEnd)
+{
+    QueryPlan plan;
+    plan.range = bPlusTree->estimateRange(pointsHomeStart, pointsHomeEnd, numRecords);
+    double numMatches = plan.range.numRecords;
+    double totalBlocks = max(1, numBlocks);
+    plan.numDataBlocks = min(numMatches, totalBlocks * (1 - pow(1 - 1 / totalBlocks, numMatches)));
+
+    // In key order, a block holding several records is read again if more blocks are visited than fit in the buffer pool
+    double indexCost = (bPlusTree->height + plan.range.numLeaves) * RANDOM_READ_COST;
+    double numFrames = bufferPool->numFrames;
+    double numBlockReads = plan.numDataBlocks;
+    if (plan.numDataBlocks > numFrames) {
+        numBlockReads += (numMatches - plan.numDataBlocks) * (1 - numFrames / plan.numDataBlocks);
+    }
+    plan.costs[INDEX_SCAN] = indexCost + numBlockReads * RANDOM_READ_COST + numMatches * RECORD_CPU_COST;
+
+    double blockReadCost = SEQUENTIAL_READ_COST + (RANDOM_READ_COST - SEQUENTIAL_READ_COST) * (1 - plan.numDataBlocks / totalBlocks);
+    plan.costs[SORTED_INDEX_SCAN] = indexCost + plan.numDataBlocks * blockReadCost
+                                    + numMatches * (1 + log2(numMatches + 1)) * RECORD_CPU_COST;
+
+    plan.costs[FULL_SCAN] = numBlocks * SEQUENTIAL_READ_COST + numRecords * RECORD_CPU_COST;
+
+    plan.accessPath = INDEX_SCAN;
+    for (int path = 0; path < NUM_ACCESS_PATHS; path++) {
+        if (plan.costs[path] < plan.costs[plan.accessPath]) {
+            plan.accessPath = (AccessPath)path;
+        }
+    }
+    return plan;
+}
 
-    return;
+/**
+ * @brief Retrieves the records whose key lies within a range with the access path chosen by planRangeQuery().
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param output The output file stream to write the plan and the statistics of the access path to.
+ * @return The records found.
+ */
+vector<GameData> Database::executeRangeQuery(float pointsHomeStart, float pointsHomeEnd, ofstream &output)
+{
+    static const char* const ACCESS_PATH_NAMES[NUM_ACCESS_PATHS] = {"index scan", "block-sorted index scan", "full scan"};
+    QueryPlan plan = planRangeQuery(pointsHomeStart, pointsHomeEnd);
+    if (output.is_open()) {
+        output << "Planner estimate: " << (long long)round(plan.range.numRecords) << " records (" << (plan.range.isExact ? "counted" : "estimated")
+               << ") in " << (long long)round(plan.numDataBlocks) << " data blocks\n";
+        output << "Planner costs:";
+        for (int path = 0; path < NUM_ACCESS_PATHS; path++) {
+            output << (path == 0 ? " " : ", ") << ACCESS_PATH_NAMES[path] << " " << plan.costs[path];
+        }
+        output << "\n";
+        output << "Planner chose: " << ACCESS_PATH_NAMES[plan.accessPath] << "\n";
+    }
+
+    switch (plan.accessPath) {
+        case SORTED_INDEX_SCAN:
+            return retrieveRecordsByBlock(pointsHomeStart, pointsHomeEnd, output);
+        case FULL_SCAN:
+            return linearScan(pointsHomeStart, pointsHomeEnd, output);
+        default:
+            return retrieveRecords(pointsHomeStart, pointsHomeEnd, output);
+    }
+}
+
+// Answers a range aggregate from the aggregates held in the B+ tree nodes, without reading any data block
+/**
+ * @brief Computes the COUNT, SUM and AVG of the aggregated column over the records whose key lies within a range.
+ *
+ * Only the nodes on the root-to-leaf paths of the two range boundaries are accessed.
+ *
+ * @param pointsHomeStart The starting key value (inclusive).
+ * @param pointsHomeEnd The ending key value (inclusive).
+ * @param output The output file stream to write the aggregates and statistics to.
+ * @return The COUNT and SUM of the aggregated column.
+ */
+AggregateResult Database::aggregateFromIndex(float pointsHomeStart, float pointsHomeEnd, ofstream &output)
+{
+    if (aggregateColumn == -1) {
+        throw runtime_error("The B+ tree nodes do not hold any aggregates.");
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    AggregateResult result = bPlusTree->aggregateRange(pointsHomeStart, pointsHomeEnd);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    if (output.is_open()) {
+        const char* name = getColumnName((GameColumn)aggregateColumn);
+        output << "Total number of index nodes accessed by aggregation: " << bPlusTree->numIndexAccessed << "\n";
+        output << "Count of " << name << ": " << result.count << "\n";
+        output << "Sum of " << name << ": " << result.sum << "\n";
+        output << "Average of " << name << ": " << result.avg() << "\n";
+        output << "Running time for Aggregation from the index: " << elapsedTime.count() << " microseconds \n";
+    }
+    return result;
 }
@@ -6,14 +6,40 @@
 #include <list>
 #include <algorithm>
 #include <set>
+#include <unordered_set>
+#include <vector>
 #include "DiskAllocation.h"
 #include "BPlusTree.h"
+#include "BufferPool.h"
+#include "Aggregation.h"
+#include "ThreadPool.h"
 #include "ProjectStructure.h"
 #include <string>
 #include <fstream>
+#include <mutex>
 
 using namespace std;
 
+/**
+ * @brief Ways of retrieving the records whose key lies within a range, chosen between by Database::planRangeQuery().
+ */
+enum AccessPath {
+    INDEX_SCAN, ///< Look the range up in the B+ tree and fetch the records in key order, see Database::retrieveRecords().
+    SORTED_INDEX_SCAN, ///< Look the range up in the B+ tree and fetch the records in block order, see Database::retrieveRecordsByBlock().
+    FULL_SCAN, ///< Scan every data block, see Database::linearScan().
+    NUM_ACCESS_PATHS
+};
+
+/**
+ * @brief Struct to hold the access path chosen for a range query, with the estimates it was chosen from.
+ */
+struct QueryPlan {
+    AccessPath accessPath; ///< The cheapest access path.
+    RangeEstimate range; ///< The estimated size of the range in the B+ tree.
+    double numDataBlocks; ///< The estimated number of distinct data blocks holding the records of the range.
+    double costs[NUM_ACCESS_PATHS]; ///< The estimated total work of each access path, in sequential block reads.
+};
+
 /**
  * @brief Represents a Database management system (DBMS) for game data.
  */
@@ -24,29 +50,129 @@ public:
     int MAX_RECORDS; ///< The maximum number of records for a block.
     int numRecords; ///< The total number of records.
     int numBlocks; ///< The total number of blocks.
+    BlockLayout blockLayout; ///< The layout of the records within a data block.
+    int aggregateColumn; ///< The GameColumn whose COUNT and SUM are held in the B+ tree nodes, or -1 for none.
+    NodeLayout nodeLayout; ///< The layout of the fields within a B+ tree node.
+    unsigned int columnOffsets[NUM_GAME_COLUMNS]; ///< The offset of each column's minipage within a PAX data block.
 
-    list<void*> freeBlocks; ///< List of blocks that can still accommodate additional records.
+    vector<unordered_set<int>> freeSpaceMap; ///< IDs of the data blocks with free slots, bucketed by their number of free slots.
     BPlusTree* bPlusTree; ///< Pointer to the B+ tree used for indexing.
     DiskAllocation* disk; ///< Pointer to disk allocation manager.
+    BufferPool* bufferPool; ///< Pointer to the buffer pool through which data blocks are read and written.
+    ThreadPool* threadPool; ///< Pointer to the worker threads running parallel scans, nullptr until getThreadPool() first creates them.
+    unsigned int numThreads; ///< The number of workers of threadPool, or 0 for one per core. Only read when threadPool is created.
+    mutex threadPoolLatch; ///< Guards the creation of threadPool.
     void* initialBlockPtr; ///< Pointer to the initial block.
+    bool isConcurrent; ///< Whether several threads may insert and retrieve records at the same time, see enableConcurrency().
+    mutex storageLatch; ///< Serialises the accesses to the data blocks and the buffer pool.
 
     /**
      * @brief Constructs a new Database object.
      *
      * @param diskSize The size of the virtual disk in megabytes (MB).
      * @param blockSize The size of each block in bytes.
+     * @param numFrames The number of frames of the buffer pool caching the data blocks.
+     * @param policy The replacement policy of the buffer pool.
+     * @param layout The layout of the records within a data block.
+     * @param aggregatedColumn The GameColumn whose COUNT and SUM are held in the B+ tree nodes, or -1 for none.
+     * @param layoutOfNodes The layout of the fields within a B+ tree node.
      */
-    Database(unsigned int diskSize, unsigned int blockSize);
+    Database(unsigned int diskSize, unsigned int blockSize, int numFrames = 1024, ReplacementPolicy policy = CLOCK, BlockLayout layout = NSM,
+             int aggregatedColumn = -1, NodeLayout layoutOfNodes = PACKED_NODES);
+
+    /**
+     * @brief Opens the Database stored in a file, or creates it in the file if it does not exist yet.
+     *
+     * The virtual disk is a memory-mapped file and the B+ tree nodes are stored in its blocks, so a
+     * reopened Database can be queried straight away without importing the data again.
+     *
+     * @param filePath The path of the file holding the virtual disk.
+     * @param diskSize The size of the virtual disk in megabytes (MB), if it is created.
+     * @param blockSize The size of each block in bytes, if the disk is created.
+     * @param numFrames The number of frames of the buffer pool caching the data blocks.
+     * @param policy The replacement policy of the buffer pool.
+     * @param layout The layout of the records within a data block, if the disk is created. A reopened disk keeps its layout.
+     * @param aggregatedColumn The GameColumn whose COUNT and SUM are held in the B+ tree nodes, or -1 for none, if the disk is created.
+     * @param layoutOfNodes The layout of the fields within a B+ tree node, if the disk is created. A reopened disk keeps its layout.
+     */
+    Database(const string& filePath, unsigned int diskSize, unsigned int blockSize, int numFrames = 1024, ReplacementPolicy policy = CLOCK, BlockLayout layout = NSM,
+             int aggregatedColumn = -1, NodeLayout layoutOfNodes = PACKED_NODES);
 
     /**
      * @brief Destroys the Database object and frees allocated memory.
      */
     ~Database();
 
+    /**
+     * @brief Lets several threads insert and retrieve records at the same time.
+     *
+     * The B+ tree is switched to latch coupling (see BPlusTree::enableConcurrency()), so index lookups and
+     * inserts proceed in parallel. Storing records and reading data blocks through the buffer pool are
+     * serialised by storageLatch, which is never held while the B+ tree is being searched.
+     *
+     * @param optimisticReads Whether index lookups take no latches and validate node versions instead, which
+     * suits workloads made mostly of lookups.
+     */
+    void enableConcurrency(bool optimisticReads = false);
+
+    /**
+     * @brief Gets the worker threads running parallel scans, creating numThreads of them on the first call.
+     *
+     * A database that is only used serially therefore never starts any worker thread.
+     *
+     * @return The thread pool.
+     */
+    ThreadPool& getThreadPool();
+
+    /**
+     * @brief Works out the capacity of a data block and, for the PAX layout, where each column's minipage starts.
+     *
+     * Each minipage is aligned to the size of its column and holds MAX_RECORDS values.
+     */
+    void setupBlockLayout();
+
+    /**
+     * @brief Writes the dirty data blocks of the buffer pool and the state of the database and its B+ tree
+     * to the disk, and flushes a file-backed disk to its file.
+     */
+    void sync();
+
+    /**
+     * @brief Saves the data blocks and the B+ tree of the database to a snapshot file.
+     *
+     * The snapshot holds the data blocks in use and the B+ tree nodes in a versioned binary format, with the
+     * references between the nodes renumbered into node indexes, so that it can be loaded into any free blocks.
+     *
+     * @param path The path of the snapshot file, which is overwritten.
+     * @throws runtime_error If the file cannot be written.
+     */
+    void saveSnapshot(const string& path);
+
+    /**
+     * @brief Loads the data blocks and the B+ tree saved in a snapshot file into this empty database.
+     *
+     * The database takes on the block layout, aggregated column and node layout of the snapshot. Reloading a snapshot
+     * only takes a few large sequential reads, instead of parsing and indexing the imported data again.
+     *
+     * @param path The path of the snapshot file.
+     * @throws runtime_error If the file cannot be read, does not hold a valid snapshot, was saved with another
+     * block size, or the database already holds records.
+     */
+    void loadSnapshot(const string& path);
+
+    /**
+     * @brief Rebuilds the free-space map from the headers of the data blocks on the disk.
+     */
+    void rebuildFreeSpaceMap();
+
     /**
      * @brief Imports data from an external source and populates the database.
+     *
+     * All records are stored into data blocks first and the B+ tree is then bulk loaded in a single pass.
+     *
+     * @param fillFactor The fraction (0, 1] of each B+ tree node to fill when building the index.
      */
-    void importData();
+    void importData(float fillFactor = 1.0f);
 
     /**
      * @brief Inserts a game data record into the database.
@@ -55,6 +181,199 @@ public:
      */
     void insertRecord(GameData gameData);
 
+    /**
+     * @brief Stores a game data record into a data block without indexing it.
+     *
+     * @param gameData The game data record to store.
+     * @return The pointer-block pair of the stored record, to be inserted into the B+ tree.
+     */
+    pointerBlockPair storeRecord(GameData gameData);
+
+    /**
+     * @brief Deletes a record from its data block without removing it from the B+ tree.
+     *
+     * The slot of the record is pushed onto the free-slot chain of its block, where it is reused by the next
+     * record stored in the block. A block left without records is returned to the disk.
+     *
+     * @param record The pointer-block pair of the record.
+     * @throws runtime_error If the slot does not hold a record.
+     */
+    void deleteRecord(pointerBlockPair record);
+
+    /**
+     * @brief Deletes the records whose key lies within a range from both the B+ tree and their data blocks.
+     *
+     * Data blocks left empty are returned to the disk. The blocks of B+ tree nodes left empty go on the free list of the
+     * node pool, where new nodes reuse them before the node extent grows. The storage reclaimed is reported.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param output The output file stream to write the statistics to.
+     * @return The number of records deleted.
+     */
+    int deleteRecords(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
+
+    /**
+     * @brief Reads a record from a data block.
+     *
+     * @param block The data block, or the buffer pool frame holding it.
+     * @param slot The index of the record in the block.
+     * @return The record.
+     */
+    GameData readRecord(void* block, int slot);
+
+    /**
+     * @brief Writes a record into a data block.
+     *
+     * @param block The data block, or the buffer pool frame holding it.
+     * @param slot The index of the record in the block.
+     * @param gameData The record to write.
+     */
+    void writeRecord(void* block, int slot, const GameData& gameData);
+
+    /**
+     * @brief Reads the value of a column of a record in a data block, converted to a double.
+     *
+     * @param block The data block, or the buffer pool frame holding it.
+     * @param slot The index of the record in the block.
+     * @param column The column to read.
+     * @return The value of the column.
+     */
+    double readColumnValue(void* block, int slot, GameColumn column);
+
+    /**
+     * @brief Reads the value of the column aggregated in the B+ tree nodes for a record.
+     *
+     * @param record The pointer-block pair of the record.
+     * @return The value of the aggregated column.
+     */
+    double readPayload(pointerBlockPair record);
+
+    /**
+     * @brief Gets the name of a column.
+     *
+     * @param column The column.
+     * @return The name of the column.
+     */
+    const char* getColumnName(GameColumn column);
+
+    /**
+     * @brief Gets the contiguous values of a column within a PAX data block.
+     *
+     * The value of the record in slot i is at index i of the returned array.
+     *
+     * @param block The data block, or the buffer pool frame holding it.
+     * @param column The column to get.
+     * @return The start of the column's minipage, or nullptr if the blocks use the NSM layout.
+     */
+    void* getColumn(void* block, GameColumn column);
+
+    /**
+     * @brief Retrieves the records whose key lies within a range, reading their data blocks through the buffer pool.
+     *
+     * The hits and misses of the buffer pool during the retrieval give the number of data blocks actually read from the disk.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param output The output file stream to write the statistics to.
+     * @return The records found.
+     */
+    vector<GameData> retrieveRecords(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
+
+    /**
+     * @brief Computes the COUNT, SUM, AVG, MIN and MAX of a column over the records whose key lies within a range.
+     *
+     * Each data block holding a matching record is read once, and the number of data blocks touched is reported.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param column The column to aggregate.
+     * @param output The output file stream to write the aggregates and statistics to.
+     * @return The aggregates of the column.
+     */
+    AggregateResult aggregate(float pointsHomeStart, float pointsHomeEnd, GameColumn column, ofstream &output);
+
+    /**
+     * @brief Computes the COUNT, SUM, AVG, MIN and MAX of a column over the records whose key lies within a range,
+     * on every worker of threadPool.
+     *
+     * The range is split into morsels of adjacent leaves (see BPlusTree::scanParallel()), and each worker aggregates
+     * the morsels it takes into its own partial aggregate, the partial aggregates being merged at the end. The buffer
+     * pool serves one thread at a time, so its dirty blocks are written back first and the workers read the data
+     * blocks on the disk in place. A data block holding records of several morsels is counted once for each.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param column The column to aggregate.
+     * @param output The output file stream to write the aggregates and statistics to.
+     * @return The aggregates of the column.
+     */
+    AggregateResult aggregateParallel(float pointsHomeStart, float pointsHomeEnd, GameColumn column, ofstream &output);
+
+    /**
+     * @brief Retrieves the records whose key lies within a range by scanning every data block, without the B+ tree.
+     *
+     * The data blocks are listed from the record bitmap of the disk and split into runs of adjacent blocks, which
+     * the workers of threadPool scan. Within a block, the key column is filtered several slots at a time with
+     * RangeFilter, and only the records selected are read. As with aggregateParallel(), the dirty blocks of the
+     * buffer pool are written back first and the data blocks are read on the disk in place.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param output The output file stream to write the statistics to.
+     * @return The records found, in the order of their data blocks.
+     */
+    vector<GameData> linearScan(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
+
+    /**
+     * @brief Retrieves the records whose key lies within a range, fetching each data block holding them once.
+     *
+     * The records found in the B+ tree are sorted by data block before their blocks are read through the buffer pool,
+     * so a block holding several of them is never read again after being evicted.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param output The output file stream to write the statistics to.
+     * @return The records found, in the order of their data blocks.
+     */
+    vector<GameData> retrieveRecordsByBlock(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
+
+    /**
+     * @brief Chooses the cheapest access path to retrieve the records whose key lies within a range.
+     *
+     * The number of records in the range comes from BPlusTree::estimateRange(). Records are stored in the order they
+     * are inserted rather than by key, so the number of distinct data blocks holding them is estimated with Cardenas'
+     * formula, as if they were spread evenly over the data blocks. Fetching records in key order reads a block again
+     * whenever it has been evicted from the buffer pool in between, fetching them in block order reads each block once,
+     * and a full scan reads every block sequentially. Every path is costed by its total work, whatever the number of
+     * workers the full scan runs on, so the same range gets the same plan on any machine.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @return The plan, with the cost of every access path.
+     */
+    QueryPlan planRangeQuery(float pointsHomeStart, float pointsHomeEnd);
+
+    /**
+     * @brief Retrieves the records whose key lies within a range with the access path chosen by planRangeQuery().
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param output The output file stream to write the plan and the statistics of the access path to.
+     * @return The records found.
+     */
+    vector<GameData> executeRangeQuery(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
+
+    /**
+     * @brief Computes the COUNT, SUM and AVG of the aggregated column over a key range from the B+ tree nodes alone.
+     *
+     * @param pointsHomeStart The starting key value (inclusive).
+     * @param pointsHomeEnd The ending key value (inclusive).
+     * @param output The output file stream to write the aggregates and statistics to.
+     * @return The COUNT and SUM of the aggregated column. The minimum and maximum are not available.
+     * @throws runtime_error If the B+ tree nodes hold no aggregates.
+     */
+    AggregateResult aggregateFromIndex(float pointsHomeStart, float pointsHomeEnd, ofstream &output);
+
     /**
      * @brief Prints the content of a data block to an output file.
      *
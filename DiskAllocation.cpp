@@ -1,49 +1,403 @@
 #include "DiskAllocation.h"
+#include <stdexcept>
+#include <mutex>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <malloc.h>
+#endif
+
+static const char DISK_MAGIC[8] = {'D', 'S', 'P', 'P', 'D', 'I', 'S', 'K'};
+static const unsigned int DISK_VERSION = 9;
+
+// Number of blocks reserved at once for B+ tree nodes, which is one word of the free-space bitmap
+static const int NODE_EXTENT_SIZE = 64;
+
 /**
  * @brief This constructor initializes the DiskAllocation class with a specified total size and block size.
- * It allocates memory for the disk and sets up a mapping table to manage disk blocks.
+ * It allocates memory for the disk and sets up a two-level bitmap to track which disk blocks are in use.
  * @param size The total size of the disk in megabytes.
  * @param sizeOfBlock The size of each disk block in bytes.
  */
 DiskAllocation::DiskAllocation(int size, int sizeOfBlock)
 {
     blockSize = sizeOfBlock;
-    disk = malloc(size*1000000);
+    diskSize = (size_t)size*1000000;
+    // Start the disk on a cache line boundary, like a memory-mapped disk which starts on a page boundary
+#ifdef _WIN32
+    disk = _aligned_malloc(diskSize, CACHE_LINE_SIZE);
+#else
+    disk = aligned_alloc(CACHE_LINE_SIZE, (diskSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE);
+#endif
+    fileDescriptor = -1;
+    isFileBacked = false;
+    isReopened = false;
+
+    formatDisk();
+}
+
+/**
+ * @brief This constructor opens the disk stored in a file, or creates it if the file does not hold a disk yet.
+ * The file is mapped into memory, so changes made to the blocks are written back to the file.
+ * Blocks only refer to each other by block ID, so an existing disk can be mapped at any address.
+ * @param filePath The path of the file holding the disk.
+ * @param size The total size of the disk in megabytes, if it is created.
+ * @param sizeOfBlock The size of each disk block in bytes, if the disk is created.
+ */
+DiskAllocation::DiskAllocation(const string& filePath, int size, int sizeOfBlock)
+{
+#ifdef _WIN32
+    throw runtime_error("File-backed disks are not supported on this platform.");
+#else
+    isFileBacked = true;
+    fileDescriptor = open(filePath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fileDescriptor < 0) {
+        throw runtime_error("Unable to open the disk file " + filePath + ".");
+    }
+
+    struct stat fileStatus;
+    fstat(fileDescriptor, &fileStatus);
+
+    if ((size_t)fileStatus.st_size >= sizeof(Superblock)) {
+        // Read the superblock to find out how large the existing disk was
+        Superblock header;
+        if (pread(fileDescriptor, &header, sizeof(Superblock), 0) != sizeof(Superblock)
+            || memcmp(header.magic, DISK_MAGIC, sizeof(DISK_MAGIC)) != 0 || header.version != DISK_VERSION) {
+            close(fileDescriptor);
+            throw runtime_error(filePath + " does not hold a valid disk.");
+        }
+
+        // Reject a header describing a disk larger than the file, or bitmaps lying outside of it, before mapping it
+        diskSize = (size_t)header.numOfBlocks*header.blockSize;
+        size_t numWords = ((size_t)header.numOfBlocks + 63) / 64;
+        if (header.blockSize == 0 || header.numOfBlocks == 0 || diskSize / header.blockSize != header.numOfBlocks
+            || (size_t)fileStatus.st_size < diskSize
+            || header.numOfMapWords != numWords || header.numOfSummaryWords != (numWords + 63) / 64
+            || header.freeMapOffset > diskSize || diskSize - header.freeMapOffset < numWords * 8
+            || header.summaryMapOffset > diskSize || diskSize - header.summaryMapOffset < header.numOfSummaryWords * 8
+            || header.recordMapOffset > diskSize || diskSize - header.recordMapOffset < numWords * 8) {
+            close(fileDescriptor);
+            throw runtime_error(filePath + " does not hold a valid disk.");
+        }
+        disk = mmap(nullptr, diskSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        if (disk == MAP_FAILED) {
+            close(fileDescriptor);
+            throw runtime_error("Unable to map the disk file " + filePath + ".");
+        }
+
+        isReopened = true;
+        loadDisk();
+    } else {
+        // Create a new disk in the file
+        blockSize = sizeOfBlock;
+        diskSize = (size_t)size*1000000;
+        if (ftruncate(fileDescriptor, diskSize) != 0) {
+            close(fileDescriptor);
+            throw runtime_error("Unable to allocate the disk file " + filePath + ".");
+        }
+        disk = mmap(nullptr, diskSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        if (disk == MAP_FAILED) {
+            close(fileDescriptor);
+            throw runtime_error("Unable to map the disk file " + filePath + ".");
+        }
+
+        isReopened = false;
+        formatDisk();
+    }
+#endif
+}
+
+/**
+ * @brief This destructor releases the disk. A file-backed disk is written back to its file and unmapped,
+ * while a disk held in memory is freed.
+ */
+DiskAllocation::~DiskAllocation()
+{
+#ifndef _WIN32
+    if (isFileBacked) {
+        sync();
+        munmap(disk, diskSize);
+        close(fileDescriptor);
+        return;
+    }
+    free(disk);
+#else
+    _aligned_free(disk);
+#endif
+}
+
+/**
+ * @brief This function lays out a new disk. The superblock is written to the start of the disk and followed by the bitmaps,
+ * and the blocks they occupy are marked as in use.
+ */
+void DiskAllocation::formatDisk()
+{
+    // Split disk into blocks and work out where the bitmaps are placed after the superblock
+    numOfBlocks = diskSize / blockSize;
+    size_t numWords = (numOfBlocks + 63) / 64;
+    size_t numSummaryWords = (numWords + 63) / 64;
 
-    // Initialise mapTable - i.e. split disk into blocks
-    numOfBlocks = (size*1000000) / sizeOfBlock;
-    int i;
-    for (i=0; i<numOfBlocks; i++)
-    {
-        // Add offset to disk's base address to get this block's address
-        void* blockAddress = reinterpret_cast<void*>(reinterpret_cast<char*>(disk) + i*sizeOfBlock);
-        mapTable[blockAddress] = true;
-        emptyBlocks.push_back(blockAddress);
+    superblock = (Superblock*)disk;
+    memset(superblock, 0, sizeof(Superblock));
+    memcpy(superblock->magic, DISK_MAGIC, sizeof(DISK_MAGIC));
+    superblock->version = DISK_VERSION;
+    superblock->blockSize = blockSize;
+    superblock->numOfBlocks = numOfBlocks;
+    superblock->numOfMapWords = numWords;
+    superblock->numOfSummaryWords = numSummaryWords;
+    superblock->freeMapOffset = (sizeof(Superblock) + 7) / 8 * 8;
+    superblock->summaryMapOffset = superblock->freeMapOffset + numWords*sizeof(uint64_t);
+    superblock->recordMapOffset = superblock->summaryMapOffset + numSummaryWords*sizeof(uint64_t);
+    size_t metaSize = superblock->recordMapOffset + numWords*sizeof(uint64_t);
+    superblock->numOfMetaBlocks = (metaSize + blockSize - 1) / blockSize;
+    superblock->initialBlockId = -1;
+    superblock->rootBlockId = -1;
+    superblock->aggregateColumn = -1;
+    superblock->nodeFreeListHead = -1;
+    superblock->nodeExtentNext = 0;
+    superblock->nodeExtentEnd = 0;
+
+    freeMap = (uint64_t*)((char*)disk + superblock->freeMapOffset);
+    summaryMap = (uint64_t*)((char*)disk + superblock->summaryMapOffset);
+    recordMap = (uint64_t*)((char*)disk + superblock->recordMapOffset);
+
+    // Initialise the bitmaps with all blocks unused, clearing the bits past the last block and past the last word of freeMap
+    for (size_t i = 0; i < numWords; i++) {
+        freeMap[i] = ~(uint64_t)0;
+        recordMap[i] = 0;
+    }
+    for (size_t i = 0; i < numSummaryWords; i++) {
+        summaryMap[i] = ~(uint64_t)0;
+    }
+    if (numOfBlocks % 64 != 0) {
+        freeMap[numWords - 1] = ((uint64_t)1 << (numOfBlocks % 64)) - 1;
+    }
+    if (numWords % 64 != 0) {
+        summaryMap[numSummaryWords - 1] = ((uint64_t)1 << (numWords % 64)) - 1;
+    }
+    numOfUnusedBlocks = numOfBlocks;
+    summaryHint = 0;
+
+    // The superblock and the bitmaps occupy the first blocks of the disk
+    for (unsigned int i = 0; i < superblock->numOfMetaBlocks; i++) {
+        markUsed(i);
+    }
+}
+
+/**
+ * @brief This function sets up the bitmaps of an existing disk from the offsets stored in its superblock.
+ */
+void DiskAllocation::loadDisk()
+{
+    superblock = (Superblock*)disk;
+    blockSize = superblock->blockSize;
+    numOfBlocks = superblock->numOfBlocks;
+    freeMap = (uint64_t*)((char*)disk + superblock->freeMapOffset);
+    summaryMap = (uint64_t*)((char*)disk + superblock->summaryMapOffset);
+    recordMap = (uint64_t*)((char*)disk + superblock->recordMapOffset);
+
+    numOfUnusedBlocks = 0;
+    for (unsigned int i = 0; i < superblock->numOfMapWords; i++) {
+        numOfUnusedBlocks += __builtin_popcountll(freeMap[i]);
     }
+    summaryHint = 0;
 }
 
 /**
- * @brief This function toggles the usage status of a disk block specified by its address in the mapping table.
- * It updates the mapping table to mark the block as used or unused.
- * @param blockAddr The address of the disk block to update in the mapping table.
+ * @brief This function writes the content of a file-backed disk back to its file.
+ */
+void DiskAllocation::sync()
+{
+#ifndef _WIN32
+    if (isFileBacked) {
+        msync(disk, diskSize, MS_SYNC);
+    }
+#endif
+}
+
+/**
+ * @brief This function toggles the usage status of a disk block specified by its address in the bitmap.
+ * It updates the bitmap to mark the block as used or unused.
+ * @param blockAddr The address of the disk block to update in the bitmap.
  */
 //Toggles whether block is in use or not
 void DiskAllocation::updateMapTable(void* blockAddr)
 {
-    mapTable[blockAddr] = !mapTable[blockAddr];
-    if (mapTable[blockAddr]) { // block is now unused
-        emptyBlocks.push_back(blockAddr);
+    lock_guard<mutex> lock(allocationLatch);
+    int blockId = fetchBlockId(blockAddr);
+    if (isBlockUsed(blockId)) { // block is now unused
+        markUnused(blockId);
+        recordMap[blockId / 64] &= ~((uint64_t)1 << (blockId % 64));
+    } else {
+        markUsed(blockId);
+    }
+}
+
+/**
+ * @brief This function computes the address of a block from its ID.
+ * @param blockId The ID of the block.
+ * @return The address of the block.
+ */
+void* DiskAllocation::fetchBlockAddress(int blockId)
+{
+    // Add offset to disk's base address to get this block's address
+    return reinterpret_cast<char*>(disk) + (size_t)blockId*blockSize;
+}
+
+/**
+ * @brief This function computes the ID of a block from its address.
+ * @param blockAddr The address of the block.
+ * @return The ID of the block.
+ */
+int DiskAllocation::fetchBlockId(void* blockAddr)
+{
+    return (reinterpret_cast<char*>(blockAddr) - reinterpret_cast<char*>(disk)) / blockSize;
+}
+
+/**
+ * @brief This function checks the bitmap to see whether a block is in use.
+ * @param blockId The ID of the block.
+ * @return True if the block is in use, false otherwise.
+ */
+bool DiskAllocation::isBlockUsed(int blockId)
+{
+    return !((freeMap[blockId / 64] >> (blockId % 64)) & 1);
+}
+
+/**
+ * @brief This function sets or clears the bit of a block in the bitmap of blocks holding records.
+ * @param blockAddr The address of the block.
+ * @param holdsRecords Whether the block holds records.
+ */
+void DiskAllocation::setRecordBlock(void* blockAddr, bool holdsRecords)
+{
+    lock_guard<mutex> lock(allocationLatch);
+    int blockId = fetchBlockId(blockAddr);
+    if (holdsRecords) {
+        recordMap[blockId / 64] |= (uint64_t)1 << (blockId % 64);
+    } else {
+        recordMap[blockId / 64] &= ~((uint64_t)1 << (blockId % 64));
     }
 }
 
 /**
- * @brief This function retrieves the address of the first available (unused) block in the list of free blocks and removes it from the list.
- * @return The address of the first unused block in the list.
+ * @brief This function checks the bitmap of blocks holding records.
+ * @param blockId The ID of the block.
+ * @return True if the block holds records, false otherwise.
  */
-//Returns the address of the first free block in the list of free blocks remaining and pop it
+bool DiskAllocation::isRecordBlock(int blockId)
+{
+    return (recordMap[blockId / 64] >> (blockId % 64)) & 1;
+}
+
+/**
+ * @brief This function finds the unused block with the lowest ID using find-first-set on the bitmaps and marks it as in use.
+ * @return The address of the unused block, or nullptr if there are no unused blocks left.
+ */
+//Returns the address of the first free block remaining and mark it as in use
 void* DiskAllocation::getUnusedBlock()
 {
-    void* blockAddr = emptyBlocks.front();
-    emptyBlocks.pop_front();
-    return blockAddr;
-}
\ No newline at end of file
+    lock_guard<mutex> lock(allocationLatch);
+    return takeUnusedBlock();
+}
+
+/**
+ * @brief This function finds the unused block with the lowest ID and marks it as in use, without taking the allocation latch.
+ * @return The address of the unused block, or nullptr if there are no unused blocks left.
+ */
+void* DiskAllocation::takeUnusedBlock()
+{
+    // Skip over the summary words whose blocks are all in use
+    while (summaryHint < superblock->numOfSummaryWords && summaryMap[summaryHint] == 0) {
+        summaryHint++;
+    }
+    if (summaryHint == superblock->numOfSummaryWords) {
+        return nullptr;
+    }
+
+    size_t word = summaryHint*64 + __builtin_ctzll(summaryMap[summaryHint]);
+    int blockId = word*64 + __builtin_ctzll(freeMap[word]);
+    markUsed(blockId);
+    return fetchBlockAddress(blockId);
+}
+
+/**
+ * @brief This function hands out a block for a B+ tree node. Released node blocks are reused first, most recently released first,
+ * and otherwise the next block of the current node extent is used. A new extent of NODE_EXTENT_SIZE contiguous blocks is reserved
+ * once the current one is used up, so that nodes created one after another (such as consecutive leaves) sit next to each other.
+ * @return The address of the block, or nullptr if every block on the disk is in use.
+ */
+//Returns a block from the node pool, reserving a new extent of blocks for it if needed
+void* DiskAllocation::getNodeBlock()
+{
+    lock_guard<mutex> lock(allocationLatch);
+
+    // Reuse the most recently released node block, whose first bytes hold the next released node block
+    if (superblock->nodeFreeListHead != -1) {
+        void* blockAddr = fetchBlockAddress(superblock->nodeFreeListHead);
+        superblock->nodeFreeListHead = *(int*)blockAddr;
+        return blockAddr;
+    }
+
+    if (superblock->nodeExtentNext == superblock->nodeExtentEnd) {
+        // Reserve a word of the bitmap whose blocks are all unused, or fall back to any single unused block
+        size_t word = summaryHint*64;
+        while (word < superblock->numOfMapWords && freeMap[word] != ~(uint64_t)0) {
+            word++;
+        }
+        if (word == superblock->numOfMapWords) {
+            return takeUnusedBlock();
+        }
+        freeMap[word] = 0;
+        summaryMap[word / 64] &= ~((uint64_t)1 << (word % 64));
+        numOfUnusedBlocks -= NODE_EXTENT_SIZE;
+        superblock->nodeExtentNext = word*64;
+        superblock->nodeExtentEnd = word*64 + NODE_EXTENT_SIZE;
+    }
+    return fetchBlockAddress(superblock->nodeExtentNext++);
+}
+
+/**
+ * @brief This function returns the block of a node removed from the B+ tree to the node pool. The block stays in use,
+ * and is linked to the previously released node block through its first bytes.
+ * @param blockAddr The address of the block, or of any byte within it.
+ */
+void DiskAllocation::releaseNodeBlock(void* blockAddr)
+{
+    lock_guard<mutex> lock(allocationLatch);
+    int blockId = fetchBlockId(blockAddr); // the node may start after the start of its block
+    *(int*)fetchBlockAddress(blockId) = superblock->nodeFreeListHead;
+    superblock->nodeFreeListHead = blockId;
+}
+
+/**
+ * @brief This function clears the bit of a block in the bitmap, and the summary bit if its word has no unused block left.
+ * @param blockId The ID of the block.
+ */
+void DiskAllocation::markUsed(int blockId)
+{
+    size_t word = blockId / 64;
+    freeMap[word] &= ~((uint64_t)1 << (blockId % 64));
+    if (freeMap[word] == 0) {
+        summaryMap[word / 64] &= ~((uint64_t)1 << (word % 64));
+    }
+    numOfUnusedBlocks--;
+}
+
+/**
+ * @brief This function sets the bit of a block in the bitmap, together with the summary bit of its word.
+ * @param blockId The ID of the block.
+ */
+void DiskAllocation::markUnused(int blockId)
+{
+    size_t word = blockId / 64;
+    freeMap[word] |= (uint64_t)1 << (blockId % 64);
+    summaryMap[word / 64] |= (uint64_t)1 << (word % 64);
+    if (word / 64 < summaryHint) {
+        summaryHint = word / 64;
+    }
+    numOfUnusedBlocks++;
+}
@@ -2,18 +2,25 @@
 #define PROJECT1_DISKALLOCATION_H
 
 #include <utility>
-#include <unordered_map>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
-#include <list>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include "ProjectStructure.h"
 
 using namespace std;
 /**
  * @brief DiskAllocation class represents a virtual disk allocation manager.
  *
  * This class provides functionality to manage a virtual disk, which is divided into blocks.
- * It keeps track of the status (used or unused) of each block on the disk.
+ * It keeps track of the status (used or unused) of each block on the disk in a two-level bitmap,
+ * and converts between block IDs and block addresses with offset arithmetic.
+ *
+ * The disk is either held in memory, or is a file mapped into memory so that it persists across runs.
+ * Block 0 onwards hold the superblock and the bitmaps, which are stored on the disk itself.
+ * Blocks may be allocated and released by several threads at once.
  */
 class DiskAllocation {
     public:
@@ -21,17 +28,41 @@ class DiskAllocation {
         void* disk; // holds disk's base address
         int blockSize;
         int numOfBlocks;
-        list<void*> emptyBlocks;
-        unordered_map<void*, bool> mapTable;    // mapTable keeps track for each block, if it is not in use
+        int numOfUnusedBlocks;
+        Superblock* superblock;     // superblock at the start of the disk
+        uint64_t* freeMap;          // bit i is set if block i is not in use
+        uint64_t* summaryMap;       // bit j is set if word j of freeMap still has a block that is not in use
+        uint64_t* recordMap;        // bit i is set if block i holds records
+        bool isFileBacked;          // whether the disk is a file mapped into memory
+        bool isReopened;            // whether the disk was loaded from an existing file instead of being created
 
         // Constructs a new disk of {size}MB and splits the disk into multiple blocks of {sizeOfBlock}B each
         /**
-         * @brief Constructs a new DiskAllocation object.
+         * @brief Constructs a new DiskAllocation object held in memory.
          * @param size The size of the virtual disk in megabytes (MB).
          * @param sizeOfBlock The size of each block in bytes.
          */
         DiskAllocation(int size, int sizeOfBlock);
 
+        // Opens the disk stored in {filePath}, or creates it with a size of {size}MB and blocks of {sizeOfBlock}B if it does not exist
+        /**
+         * @brief Constructs a DiskAllocation object backed by a memory-mapped file.
+         *
+         * If the file already holds a disk, the disk is mapped back at any address, and its
+         * block size and number of blocks are taken from its superblock. Otherwise a new disk is created in the file.
+         *
+         * @param filePath The path of the file holding the disk.
+         * @param size The size of the virtual disk in megabytes (MB), if it is created.
+         * @param sizeOfBlock The size of each block in bytes, if the disk is created.
+         * @throws runtime_error If the file cannot be opened or mapped, or does not hold a valid disk.
+         */
+        DiskAllocation(const string& filePath, int size, int sizeOfBlock);
+
+        /**
+         * @brief Destroys the DiskAllocation object, writing a file-backed disk back to its file.
+         */
+        ~DiskAllocation();
+
         // function to set a block as empty or non-empty
         /**
          * @brief Toggles whether a block is in use or not.
@@ -50,12 +81,108 @@ class DiskAllocation {
          */
         void* fetchBlockAddress(int blockId);
 
+        // function to return a block's ID
+        /**
+         * @brief Retrieves the ID of a block from its address.
+         * @param blockAddr The address of the block.
+         * @return The ID of the block.
+         */
+        int fetchBlockId(void* blockAddr);
+
+        // function to check whether a block is in use
+        /**
+         * @brief Checks whether a block is currently in use.
+         * @param blockId The ID of the block to check.
+         * @return True if the block is in use, false otherwise.
+         */
+        bool isBlockUsed(int blockId);
+
+        // function to set whether a block holds records
+        /**
+         * @brief Marks whether a block holds records, as opposed to B+ tree nodes.
+         * @param blockAddr The address of the block.
+         * @param holdsRecords Whether the block holds records.
+         */
+        void setRecordBlock(void* blockAddr, bool holdsRecords);
+
+        // function to check whether a block holds records
+        /**
+         * @brief Checks whether a block holds records.
+         * @param blockId The ID of the block to check.
+         * @return True if the block holds records, false otherwise.
+         */
+        bool isRecordBlock(int blockId);
+
         // function to get an unused block
         /**
-         * @brief Gets an unused block from the list of empty blocks.
-         * @return The address of an unused block.
+         * @brief Gets the unused block with the lowest ID and marks it as in use.
+         * @return The address of the block, or nullptr if every block on the disk is in use.
          */
         void* getUnusedBlock();
+
+        // function to get a block for a B+ tree node
+        /**
+         * @brief Gets a block for a B+ tree node from the node pool.
+         *
+         * Node blocks are carved out of extents of contiguous blocks reserved from the disk, which keeps the nodes
+         * of the tree close together instead of scattered between the data blocks. Blocks released by
+         * releaseNodeBlock() are reused first. The state of the pool is kept in the superblock.
+         *
+         * @return The address of the block, or nullptr if every block on the disk is in use.
+         */
+        void* getNodeBlock();
+
+        // function to return the block of a B+ tree node to the node pool
+        /**
+         * @brief Returns the block of a node that is no longer used to the node pool, to be reused for another node.
+         *
+         * The block stays in use on the disk.
+         *
+         * @param blockAddr The address of the block, or of any byte within it.
+         */
+        void releaseNodeBlock(void* blockAddr);
+
+        // function to write a file-backed disk back to its file
+        /**
+         * @brief Writes the content of a file-backed disk back to its file. Does nothing for a disk held in memory.
+         */
+        void sync();
+
+    private:
+
+        size_t diskSize;    // size of the disk in bytes
+        int fileDescriptor; // file holding the disk, -1 if the disk is held in memory
+        size_t summaryHint; // no summary word before this one has a block that is not in use
+        mutex allocationLatch; // serialises the updates to the bitmaps and the node pool
+
+        /**
+         * @brief Gets the unused block with the lowest ID and marks it as in use. The caller holds allocationLatch.
+         * @return The address of the block, or nullptr if every block on the disk is in use.
+         */
+        void* takeUnusedBlock();
+
+        /**
+         * @brief Lays out a new disk: writes the superblock and initialises the bitmaps with every block unused,
+         * apart from the blocks holding the superblock and the bitmaps.
+         */
+        void formatDisk();
+
+        /**
+         * @brief Sets up the bitmaps of an existing disk from its superblock.
+         */
+        void loadDisk();
+
+        /**
+         * @brief Marks a block as in use in the free-space bitmap.
+         * @param blockId The ID of the block.
+         */
+        void markUsed(int blockId);
+
+        /**
+         * @brief Marks a block as not in use in the free-space bitmap.
+         * @param blockId The ID of the block.
+         */
+        void markUnused(int blockId);
 };
 
 
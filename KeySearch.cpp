@@ -0,0 +1,156 @@
+#include "KeySearch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KEYSEARCH_X86
+#include <immintrin.h>
+#endif
+
+// Number of keys left to the compare-and-count kernel once the binary search has narrowed down the key array
+static const unsigned int SEARCH_WINDOW = 16;
+
+typedef unsigned int (*CountKernel)(const float* keys, unsigned int numKeys, float key);
+
+// Compare-and-count kernels
+// Each kernel counts the keys smaller than (or equal to, if inclusive) the search key
+/**
+ * @brief Counts the keys smaller than (or equal to) the search key one key at a time.
+ * @param keys The key array to scan.
+ * @param numKeys The number of keys in the array.
+ * @param key The key to compare against.
+ * @return The number of keys smaller than (or equal to) the key.
+ */
+template <bool inclusive>
+static unsigned int countScalar(const float* keys, unsigned int numKeys, float key) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < numKeys; i++) {
+        count += inclusive ? (keys[i] <= key) : (keys[i] < key);
+    }
+    return count;
+}
+
+#ifdef KEYSEARCH_X86
+/**
+ * @brief Counts the keys smaller than (or equal to) the search key four keys at a time using SSE2.
+ * @param keys The key array to scan.
+ * @param numKeys The number of keys in the array.
+ * @param key The key to compare against.
+ * @return The number of keys smaller than (or equal to) the key.
+ */
+template <bool inclusive>
+__attribute__((target("sse2")))
+static unsigned int countSse2(const float* keys, unsigned int numKeys, float key) {
+    __m128 searchKey = _mm_set1_ps(key);
+    unsigned int count = 0;
+    unsigned int i = 0;
+    for (; i + 4 <= numKeys; i += 4) {
+        __m128 block = _mm_loadu_ps(keys + i); // keys within a node are not guaranteed to be aligned
+        __m128 mask = inclusive ? _mm_cmple_ps(block, searchKey) : _mm_cmplt_ps(block, searchKey);
+        count += __builtin_popcount(_mm_movemask_ps(mask));
+    }
+    return count + countScalar<inclusive>(keys + i, numKeys - i, key);
+}
+
+/**
+ * @brief Counts the keys smaller than (or equal to) the search key eight keys at a time using AVX2.
+ * @param keys The key array to scan.
+ * @param numKeys The number of keys in the array.
+ * @param key The key to compare against.
+ * @return The number of keys smaller than (or equal to) the key.
+ */
+template <bool inclusive>
+__attribute__((target("avx2")))
+static unsigned int countAvx2(const float* keys, unsigned int numKeys, float key) {
+    __m256 searchKey = _mm256_set1_ps(key);
+    unsigned int count = 0;
+    unsigned int i = 0;
+    for (; i + 8 <= numKeys; i += 8) {
+        __m256 block = _mm256_loadu_ps(keys + i); // keys within a node are not guaranteed to be aligned
+        __m256 mask = _mm256_cmp_ps(block, searchKey, inclusive ? _CMP_LE_OQ : _CMP_LT_OQ);
+        count += __builtin_popcount(_mm256_movemask_ps(mask));
+    }
+    return count + countScalar<inclusive>(keys + i, numKeys - i, key);
+}
+#endif
+
+/**
+ * @brief Struct to hold the compare-and-count kernels selected for this CPU.
+ */
+struct KernelTable {
+    CountKernel countLess;
+    CountKernel countLessOrEqual;
+    const char* name;
+};
+
+// Picks the widest compare-and-count kernel supported by the CPU the program is running on
+/**
+ * @brief Selects the compare-and-count kernels based on CPU feature detection.
+ * @return The selected kernels.
+ */
+static KernelTable selectKernels() {
+#ifdef KEYSEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {countAvx2<false>, countAvx2<true>, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {countSse2<false>, countSse2<true>, "sse2"};
+    }
+#endif
+    return {countScalar<false>, countScalar<true>, "scalar"};
+}
+
+static const KernelTable kernels = selectKernels();
+
+// Narrows the key array down to a window of at most SEARCH_WINDOW keys containing the answer, then counts within the window
+// The binary search selects the next half with a conditional add instead of a branch
+/**
+ * @brief Counts the keys smaller than (or equal to) the search key in a sorted key array.
+ * @param keys The sorted key array.
+ * @param numKeys The number of keys in the array.
+ * @param key The key to search for.
+ * @param kernel The compare-and-count kernel used within the final window.
+ * @return The number of keys smaller than (or equal to) the key.
+ */
+template <bool inclusive>
+static unsigned int search(const float* keys, unsigned int numKeys, float key, CountKernel kernel) {
+    const float* base = keys;
+    unsigned int n = numKeys;
+    while (n > SEARCH_WINDOW) {
+        unsigned int half = n / 2;
+        // If the last key of the lower half still belongs before the search key, the answer lies in the upper half
+        bool goRight = inclusive ? (base[half - 1] <= key) : (base[half - 1] < key);
+        base += goRight ? half : 0;
+        n -= half;
+    }
+    return (unsigned int)(base - keys) + kernel(base, n, key);
+}
+
+/**
+ * @brief Counts the keys that are strictly smaller than a given key.
+ * @param keys The sorted key array of a node.
+ * @param numKeys The number of keys in the array.
+ * @param key The key to search for.
+ * @return The number of keys smaller than the given key.
+ */
+unsigned int KeySearch::countLess(const float* keys, unsigned int numKeys, float key) {
+    return search<false>(keys, numKeys, key, kernels.countLess);
+}
+
+/**
+ * @brief Counts the keys that are smaller than or equal to a given key.
+ * @param keys The sorted key array of a node.
+ * @param numKeys The number of keys in the array.
+ * @param key The key to search for.
+ * @return The number of keys smaller than or equal to the given key.
+ */
+unsigned int KeySearch::countLessOrEqual(const float* keys, unsigned int numKeys, float key) {
+    return search<true>(keys, numKeys, key, kernels.countLessOrEqual);
+}
+
+/**
+ * @brief Gets the name of the compare-and-count kernel selected for this CPU.
+ * @return The name of the kernel.
+ */
+const char* KeySearch::getKernelName() {
+    return kernels.name;
+}
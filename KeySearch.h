@@ -0,0 +1,45 @@
+#ifndef PROJECT1_KEYSEARCH_H
+#define PROJECT1_KEYSEARCH_H
+
+/**
+ * @brief KeySearch provides the search routines used to locate a key within the sorted key array of a B+ tree node.
+ *
+ * A branchless binary search narrows the key array down to a small window, which is then scanned by a
+ * compare-and-count kernel. The kernel (AVX2, SSE2 or scalar) is selected once at startup based on the
+ * features supported by the CPU, so searching a node stays logarithmic in the number of keys it holds.
+ */
+class KeySearch {
+    public:
+
+        /**
+         * @brief Counts the keys that are strictly smaller than a given key.
+         *
+         * For a sorted key array this is the position of the first key not smaller than the given key.
+         *
+         * @param keys The sorted key array of a node.
+         * @param numKeys The number of keys in the array.
+         * @param key The key to search for.
+         * @return The number of keys smaller than the given key.
+         */
+        static unsigned int countLess(const float* keys, unsigned int numKeys, float key);
+
+        /**
+         * @brief Counts the keys that are smaller than or equal to a given key.
+         *
+         * For a sorted key array of a non-leaf node this is the index of the pointer to follow for the given key.
+         *
+         * @param keys The sorted key array of a node.
+         * @param numKeys The number of keys in the array.
+         * @param key The key to search for.
+         * @return The number of keys smaller than or equal to the given key.
+         */
+        static unsigned int countLessOrEqual(const float* keys, unsigned int numKeys, float key);
+
+        /**
+         * @brief Gets the name of the compare-and-count kernel selected for this CPU.
+         * @return The name of the kernel ("avx2", "sse2" or "scalar").
+         */
+        static const char* getKernelName();
+};
+
+#endif //PROJECT1_KEYSEARCH_H
@@ -7,7 +7,7 @@
 
 using namespace std;
 
-#pragma pack(1)
+#pragma pack(push, 1)
 /**
  * @brief Struct to represent game data.
  */
@@ -23,29 +23,87 @@ struct GameData {
     unsigned short HOME_TEAM_WINS; //2
 };
 
+/**
+ * @brief Columns of a game data record.
+ */
+enum GameColumn {
+    GAME_DATE_EST_COLUMN,
+    TEAM_ID_HOME_COLUMN,
+    PTS_HOME_COLUMN,
+    FG_PCT_HOME_COLUMN,
+    FT_PCT_HOME_COLUMN,
+    FG3_PCT_HOME_COLUMN,
+    AST_HOME_COLUMN,
+    REB_HOME_COLUMN,
+    HOME_TEAM_WINS_COLUMN,
+    NUM_GAME_COLUMNS
+};
+
+/**
+ * @brief Layouts available to store game data records in a data block.
+ *
+ * Both layouts start with a DataBlockHeader and the indexMapping table of the block.
+ */
+enum BlockLayout {
+    NSM, ///< Whole records are stored from the tail of the block (N-ary storage model).
+    PAX ///< Each column is stored in its own contiguous minipage (Partition Attributes Across).
+};
+
+// Size of a CPU cache line, which the disk and the nodes of the ALIGNED_NODES layout are aligned to
+static const unsigned int CACHE_LINE_SIZE = 64;
+
+/**
+ * @brief Layouts available to store the fields of a B+ tree node within its block.
+ *
+ * Both layouts start with a NodeHeader, and hold the EntryAggregates of the node (if any) last.
+ */
+enum NodeLayout {
+    PACKED_NODES, ///< The header is followed by the pointers and then the keys, without any padding.
+    ALIGNED_NODES ///< The node starts on a cache line with the keys right after the header, and the pointers start on the next cache line.
+};
+
 /**
  * @brief Struct to represent index mapping.
  */
 struct indexMapping
 {
     float key;
-    int indexOfRecord; // -1 represents a deleted record in block
+    int indexOfRecord; // -1 represents a deleted record in block, whose key then holds the next slot of the free-slot chain (-1 ends it)
+};
+
+/**
+ * @brief Struct to represent the header at the start of a data block, followed by its indexMapping table.
+ *
+ * The slots of deleted records are chained through their indexMapping entries, so that a new record
+ * takes a free slot straight from the head of the chain instead of scanning the table for gravestones.
+ */
+struct DataBlockHeader
+{
+    unsigned int numSlots; // entries of the indexMapping table in use, including the free slots
+    unsigned int numRecords; // records stored in the block
+    int freeSlotHead; // first slot of the free-slot chain, -1 if no slot has been freed
 };
 
+// Smallest block size, which fits a data block header with a single record. A B+ tree node may need larger blocks, see BPlusTree.
+static const unsigned int MIN_BLOCK_SIZE = sizeof(DataBlockHeader) + sizeof(indexMapping) + sizeof(GameData);
+
 /**
  * @brief Struct to represent a pointer-block pair.
+ *
+ * The pair refers to a block by its ID rather than by its address, so that it stays valid wherever the disk is
+ * mapped. The block is resolved into an address through the DiskAllocation or the buffer pool when it is used.
  */
 struct pointerBlockPair // 8 bytes
 {
-    void* blockAddress;
-    float recordID; // -1 indicates an overflow, any positive indicates the a duplicated record
+    int blockId; // -1 if the pair leads nowhere
+    float recordID; // -1 indicates an overflow node holding duplicated records, otherwise the index of the record in its block
 };
 
 // Used to store relevant header information for a node in the B+ tree
 /**
  * @brief Struct to store header information for a node in the B+ tree.
  */
-struct NodeHeader // 14->16 (padded) bytes, multiple of 4
+struct NodeHeader // 13 bytes (packed)
 {
     unsigned int numKeys;
     pointerBlockPair pointerToParent;
@@ -53,13 +111,87 @@ struct NodeHeader // 14->16 (padded) bytes, multiple of 4
 };
 
 /**
- * @brief Struct to store duplicate counts.
+ * @brief Struct to hold the COUNT and SUM of the payload column over the records reachable from a node entry.
+ *
+ * Only stored in the nodes of a B+ tree built with aggregates. For a leaf entry it covers the records of its key,
+ * and for a non-leaf entry it covers the whole subtree of the child it points to.
  */
-struct duplicateCounter{
-    float keyValue;
-    int count;
+struct EntryAggregate
+{
+    unsigned int count;
+    double sum;
 };
 
+/**
+ * @brief Struct to represent the superblock stored at the start of the disk.
+ *
+ * The superblock describes the layout of the disk and holds the state of the database and its B+ tree,
+ * so that a disk stored in a file can be reopened without importing the data again.
+ */
+struct Superblock
+{
+    char magic[8]; // identifies a disk created by DiskAllocation
+    unsigned int version;
+    unsigned int blockSize;
+    unsigned int numOfBlocks;
+    unsigned int numOfMetaBlocks; // blocks holding the superblock and the bitmaps, starting from block 0
+    unsigned long long freeMapOffset; // offset of each bitmap from the start of the disk, in bytes
+    unsigned long long summaryMapOffset;
+    unsigned long long recordMapOffset;
+    unsigned int numOfMapWords; // number of 64-bit words in freeMap and recordMap
+    unsigned int numOfSummaryWords; // number of 64-bit words in summaryMap
+
+    // Database state
+    unsigned int numRecords;
+    unsigned int numDataBlocks;
+    int initialBlockId; // -1 if no record has been stored
+    unsigned int blockLayout; // BlockLayout of the data blocks
+
+    // B+ tree state
+    int rootBlockId;
+    unsigned int height;
+    unsigned int numNodes;
+    unsigned int numOverflowNodes;
+    int aggregateColumn; // GameColumn aggregated in the nodes, -1 if the nodes hold no aggregates
+    unsigned int nodeLayout; // NodeLayout of the nodes
+
+    // Node pool state
+    int nodeFreeListHead; // most recently released node block, each released node block holds the ID of the next one, -1 if none
+    int nodeExtentNext; // next block of the current node extent that has never been handed out
+    int nodeExtentEnd; // end of the current node extent
+};
+
+/**
+ * @brief Struct to represent the header at the start of a database snapshot file.
+ *
+ * The header is followed by the IDs of the saved data blocks, the content of those blocks, the NodeKind of
+ * each saved B+ tree node and the content of those nodes, in that order. References between the saved
+ * nodes hold the index of a saved node instead of a block ID, and references to records keep the ID of
+ * their saved data block.
+ */
+struct SnapshotHeader
+{
+    char magic[8]; // identifies a snapshot written by Database::saveSnapshot
+    unsigned int version;
+    unsigned int blockSize;
+    unsigned int blockLayout; // BlockLayout of the data blocks
+    int aggregateColumn; // GameColumn aggregated in the nodes, -1 if the nodes hold no aggregates
+    unsigned int nodeLayout; // NodeLayout of the nodes
+
+    // Database state
+    unsigned int numRecords;
+    unsigned int numDataBlocks;
+    int initialBlockId; // -1 if no record has been stored
+    unsigned int numSavedBlocks; // data blocks holding records, which are saved in the snapshot
+
+    // B+ tree state
+    unsigned int maxKeys;
+    unsigned int height;
+    unsigned int numNodes;
+    unsigned int numOverflowNodes;
+    unsigned int numSavedNodes; // nodes and overflow nodes saved in the snapshot, the root being node 0
+};
 
+#pragma pack(pop)
 
 #endif //PROJECT1_PROJECTSTRUCTURE_H
\ No newline at end of file
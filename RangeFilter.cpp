@@ -0,0 +1,138 @@
+#include "RangeFilter.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RANGEFILTER_X86
+#include <immintrin.h>
+#endif
+
+typedef unsigned int (*SelectKernel)(const float* values, unsigned int numValues, float low, float high, unsigned int* selected);
+
+// Selection kernels
+// Each kernel writes the index of every value within [low, high] to selected, and returns how many it wrote
+/**
+ * @brief Selects the values within a range one value at a time, without branching on the predicate.
+ * @param values The values to filter.
+ * @param numValues The number of values.
+ * @param low The lower bound of the range (inclusive).
+ * @param high The upper bound of the range (inclusive).
+ * @param selected Filled with the indexes of the values within the range.
+ * @return The number of values within the range.
+ */
+static unsigned int selectScalar(const float* values, unsigned int numValues, float low, float high, unsigned int* selected) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < numValues; i++) {
+        selected[count] = i; // overwritten by the next index unless the value is kept
+        count += (values[i] >= low) & (values[i] <= high);
+    }
+    return count;
+}
+
+#ifdef RANGEFILTER_X86
+/**
+ * @brief Selects the values within a range four values at a time using SSE2.
+ * @param values The values to filter.
+ * @param numValues The number of values.
+ * @param low The lower bound of the range (inclusive).
+ * @param high The upper bound of the range (inclusive).
+ * @param selected Filled with the indexes of the values within the range.
+ * @return The number of values within the range.
+ */
+__attribute__((target("sse2")))
+static unsigned int selectSse2(const float* values, unsigned int numValues, float low, float high, unsigned int* selected) {
+    __m128 lowBound = _mm_set1_ps(low);
+    __m128 highBound = _mm_set1_ps(high);
+    unsigned int count = 0;
+    unsigned int i = 0;
+    for (; i + 4 <= numValues; i += 4) {
+        __m128 block = _mm_loadu_ps(values + i); // a gathered column is not guaranteed to be aligned
+        unsigned int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(block, lowBound), _mm_cmple_ps(block, highBound)));
+        for (; mask != 0; mask &= mask - 1) {
+            selected[count++] = i + __builtin_ctz(mask);
+        }
+    }
+    unsigned int rest = selectScalar(values + i, numValues - i, low, high, selected + count);
+    for (unsigned int j = 0; j < rest; j++) {
+        selected[count + j] += i;
+    }
+    return count + rest;
+}
+
+/**
+ * @brief Selects the values within a range eight values at a time using AVX2.
+ * @param values The values to filter.
+ * @param numValues The number of values.
+ * @param low The lower bound of the range (inclusive).
+ * @param high The upper bound of the range (inclusive).
+ * @param selected Filled with the indexes of the values within the range.
+ * @return The number of values within the range.
+ */
+__attribute__((target("avx2")))
+static unsigned int selectAvx2(const float* values, unsigned int numValues, float low, float high, unsigned int* selected) {
+    __m256 lowBound = _mm256_set1_ps(low);
+    __m256 highBound = _mm256_set1_ps(high);
+    unsigned int count = 0;
+    unsigned int i = 0;
+    for (; i + 8 <= numValues; i += 8) {
+        __m256 block = _mm256_loadu_ps(values + i); // a gathered column is not guaranteed to be aligned
+        __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(block, lowBound, _CMP_GE_OQ), _mm256_cmp_ps(block, highBound, _CMP_LE_OQ));
+        unsigned int mask = _mm256_movemask_ps(inRange);
+        for (; mask != 0; mask &= mask - 1) {
+            selected[count++] = i + __builtin_ctz(mask);
+        }
+    }
+    unsigned int rest = selectScalar(values + i, numValues - i, low, high, selected + count);
+    for (unsigned int j = 0; j < rest; j++) {
+        selected[count + j] += i;
+    }
+    return count + rest;
+}
+#endif
+
+/**
+ * @brief Struct to hold the selection kernel selected for this CPU.
+ */
+struct SelectKernelEntry {
+    SelectKernel select;
+    const char* name;
+};
+
+// Picks the widest selection kernel supported by the CPU the program is running on
+/**
+ * @brief Selects the selection kernel based on CPU feature detection.
+ * @return The selected kernel.
+ */
+static SelectKernelEntry selectKernel() {
+#ifdef RANGEFILTER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {selectAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {selectSse2, "sse2"};
+    }
+#endif
+    return {selectScalar, "scalar"};
+}
+
+static const SelectKernelEntry kernel = selectKernel();
+
+/**
+ * @brief Selects the values that lie within a range.
+ * @param values The values to filter.
+ * @param numValues The number of values.
+ * @param low The lower bound of the range (inclusive).
+ * @param high The upper bound of the range (inclusive).
+ * @param selected Filled with the indexes of the values within the range.
+ * @return The number of values within the range.
+ */
+unsigned int RangeFilter::select(const float* values, unsigned int numValues, float low, float high, unsigned int* selected) {
+    return kernel.select(values, numValues, low, high, selected);
+}
+
+/**
+ * @brief Gets the name of the selection kernel selected for this CPU.
+ * @return The name of the kernel.
+ */
+const char* RangeFilter::getKernelName() {
+    return kernel.name;
+}
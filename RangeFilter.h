@@ -0,0 +1,34 @@
+#ifndef PROJECT1_RANGEFILTER_H
+#define PROJECT1_RANGEFILTER_H
+
+/**
+ * @brief RangeFilter provides the selection kernels used to apply a range predicate to the values of a column.
+ *
+ * A full table scan gathers the key column of a data block into a contiguous array (the PAX layout already stores
+ * it that way) and selects the slots whose value lies within the range, several values per comparison. The kernel
+ * (AVX2, SSE2 or scalar) is selected once at startup based on the features supported by the CPU, in the same way
+ * as KeySearch.
+ */
+class RangeFilter {
+    public:
+
+        /**
+         * @brief Selects the values that lie within a range.
+         * @param values The values to filter.
+         * @param numValues The number of values.
+         * @param low The lower bound of the range (inclusive).
+         * @param high The upper bound of the range (inclusive).
+         * @param selected Filled with the indexes of the values within the range, in increasing order. Must have room
+         * for numValues indexes.
+         * @return The number of values within the range.
+         */
+        static unsigned int select(const float* values, unsigned int numValues, float low, float high, unsigned int* selected);
+
+        /**
+         * @brief Gets the name of the selection kernel selected for this CPU.
+         * @return The name of the kernel ("avx2", "sse2" or "scalar").
+         */
+        static const char* getKernelName();
+};
+
+#endif //PROJECT1_RANGEFILTER_H
@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+// Starts one thread fewer than the number of workers, as the thread running a batch is worker 0
+/**
+ * @brief Constructs a new ThreadPool object and starts its worker threads.
+ * @param numWorkers The number of workers, including the thread running a batch, or 0 for one per core.
+ */
+ThreadPool::ThreadPool(unsigned int numWorkers) {
+    numThreads = numWorkers != 0 ? numWorkers : max(1u, thread::hardware_concurrency());
+    currentTask = nullptr;
+    batchNumber = 0;
+    numTasksLeft = 0;
+    isStopping = false;
+    for (unsigned int worker = 0; worker < numThreads; worker++) {
+        queues.push_back(make_unique<WorkerQueue>());
+    }
+    for (unsigned int worker = 1; worker < numThreads; worker++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, worker);
+    }
+}
+
+/**
+ * @brief Stops and joins the worker threads.
+ */
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> poolLock(poolLatch);
+        isStopping = true;
+    }
+    workAvailable.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Worker w is dealt the w-th contiguous run of tasks, and worker 0 starts on its run straight away
+/**
+ * @brief Runs a batch of tasks and waits for all of them to finish.
+ * @param numTasks The number of tasks, numbered from 0.
+ * @param task The function run for each task, with the number of the task and of the worker running it.
+ */
+void ThreadPool::run(size_t numTasks, const function<void(size_t task, unsigned int worker)>& task) {
+    if (numTasks == 0) {
+        return;
+    }
+    lock_guard<recursive_mutex> runLock(runLatch);
+    {
+        lock_guard<mutex> poolLock(poolLatch);
+        currentTask = &task;
+        failure = nullptr;
+        numTasksLeft = numTasks;
+        for (unsigned int worker = 0; worker < numThreads; worker++) {
+            lock_guard<mutex> queueLock(queues[worker]->latch);
+            for (size_t t = numTasks * worker / numThreads; t < numTasks * (worker + 1) / numThreads; t++) {
+                queues[worker]->tasks.push_back(t);
+            }
+        }
+        batchNumber++;
+    }
+    workAvailable.notify_all();
+
+    runTasks(0);
+
+    unique_lock<mutex> poolLock(poolLatch);
+    batchDone.wait(poolLock, [this] { return numTasksLeft == 0; });
+    currentTask = nullptr;
+    if (failure) {
+        rethrow_exception(failure);
+    }
+}
+
+/**
+ * @brief Waits for batches and runs their tasks, on a worker thread.
+ * @param worker The number of the worker.
+ */
+void ThreadPool::workerLoop(unsigned int worker) {
+    uint64_t lastBatch = 0;
+    while (true) {
+        {
+            unique_lock<mutex> poolLock(poolLatch);
+            workAvailable.wait(poolLock, [&] { return isStopping || batchNumber != lastBatch; });
+            if (isStopping) {
+                return;
+            }
+            lastBatch = batchNumber;
+        }
+        runTasks(worker);
+    }
+}
+
+// A task that throws still counts as finished, so run() always returns once the batch is over
+/**
+ * @brief Runs tasks of the current batch until no worker has a task left to take.
+ * @param worker The number of the worker.
+ */
+void ThreadPool::runTasks(unsigned int worker) {
+    size_t task;
+    while (takeTask(worker, task)) {
+        try {
+            (*currentTask)(task, worker);
+        } catch (...) {
+            lock_guard<mutex> poolLock(poolLatch);
+            if (!failure) {
+                failure = current_exception();
+            }
+        }
+        if (numTasksLeft.fetch_sub(1) == 1) {
+            lock_guard<mutex> poolLock(poolLatch);
+            batchDone.notify_all();
+        }
+    }
+}
+
+// A worker takes tasks from the front of its own queue, and steals from the back of the others, furthest from their owners
+/**
+ * @brief Takes the next task of a worker's own queue, or steals one from another worker.
+ * @param worker The number of the worker.
+ * @param task Set to the task taken.
+ * @return True if a task was taken.
+ */
+bool ThreadPool::takeTask(unsigned int worker, size_t& task) {
+    {
+        lock_guard<mutex> queueLock(queues[worker]->latch);
+        if (!queues[worker]->tasks.empty()) {
+            task = queues[worker]->tasks.front();
+            queues[worker]->tasks.pop_front();
+            return true;
+        }
+    }
+    for (unsigned int i = 1; i < numThreads; i++) {
+        WorkerQueue& victim = *queues[(worker + i) % numThreads];
+        lock_guard<mutex> queueLock(victim.latch);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
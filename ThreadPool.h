@@ -0,0 +1,100 @@
+#ifndef PROJECT1_THREADPOOL_H
+#define PROJECT1_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <cstdint>
+#include "ProjectStructure.h"
+
+using namespace std;
+
+// Number of morsels a range is split into for each worker of a parallel scan, so that workers that finish early can steal the rest
+static const unsigned int MORSELS_PER_THREAD = 4;
+
+/**
+ * @brief ThreadPool runs batches of tasks on a fixed set of worker threads, for morsel-driven parallel scans.
+ *
+ * The tasks of a batch are dealt out to the workers in contiguous runs, so that neighbouring tasks (e.g. morsels
+ * of adjacent leaves) tend to run on the same worker. A worker whose own queue is empty steals the last task of
+ * another worker's queue, so a worker given slow tasks does not hold up the batch. The thread running a batch
+ * takes part in it as worker 0.
+ */
+class ThreadPool {
+    public:
+
+        unsigned int numThreads; // number of workers, including the thread running a batch
+        recursive_mutex runLatch; // held by run() for each batch, and by callers running several batches back to back
+
+        /**
+         * @brief Constructs a new ThreadPool object and starts its worker threads.
+         * @param numWorkers The number of workers, including the thread running a batch, or 0 for one per core.
+         */
+        ThreadPool(unsigned int numWorkers = 0);
+
+        /**
+         * @brief Stops and joins the worker threads.
+         */
+        ~ThreadPool();
+
+        /**
+         * @brief Runs a batch of tasks and waits for all of them to finish.
+         *
+         * Batches run one at a time, so a thread calling run() while another batch is running waits for it. A caller
+         * holding runLatch runs its batches without batches of other threads in between.
+         *
+         * @param numTasks The number of tasks, numbered from 0.
+         * @param task The function run for each task, with the number of the task and of the worker running it.
+         * @throws The first exception thrown by a task, once every task has finished.
+         */
+        void run(size_t numTasks, const function<void(size_t task, unsigned int worker)>& task);
+
+    private:
+
+        /**
+         * @brief Struct to hold the queue of tasks of a worker, on its own cache line.
+         */
+        struct alignas(CACHE_LINE_SIZE) WorkerQueue {
+            mutex latch;
+            deque<size_t> tasks;
+        };
+
+        vector<unique_ptr<WorkerQueue>> queues; // queue of each worker
+        vector<thread> workers;                 // threads of the workers other than worker 0
+        mutex poolLatch;                        // guards the fields below
+        condition_variable workAvailable;       // signalled when a batch starts or the pool stops
+        condition_variable batchDone;           // signalled when the last task of a batch finishes
+        const function<void(size_t, unsigned int)>* currentTask; // function of the batch being run
+        uint64_t batchNumber;                   // number of batches started so far
+        atomic<size_t> numTasksLeft;            // tasks of the current batch that have not finished
+        exception_ptr failure;                  // first exception thrown by a task of the current batch
+        bool isStopping;                        // whether the workers should exit
+
+        /**
+         * @brief Waits for batches and runs their tasks, on a worker thread.
+         * @param worker The number of the worker.
+         */
+        void workerLoop(unsigned int worker);
+
+        /**
+         * @brief Runs tasks of the current batch until no worker has a task left to take.
+         * @param worker The number of the worker.
+         */
+        void runTasks(unsigned int worker);
+
+        /**
+         * @brief Takes the next task of a worker's own queue, or steals one from another worker.
+         * @param worker The number of the worker.
+         * @param task Set to the task taken.
+         * @return True if a task was taken.
+         */
+        bool takeTask(unsigned int worker, size_t& task);
+};
+
+#endif //PROJECT1_THREADPOOL_H
@@ -1,4 +1,5 @@
 #include "databaseStorage.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -8,84 +9,399 @@
 #include <filesystem>
 #include <ctime>
 #include <cmath>
+#include <charconv>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
+
+// Size of the chunks the input file is split into for parsing, so files smaller than this are parsed on a single thread
+static const size_t MIN_CHUNK_SIZE = 1 << 18;
+
+// Fields of a line are separated by tabs or spaces
+/**
+ * @brief Checks whether a character separates two fields of a line.
+ * @param c The character to check.
+ * @return True if the character is a tab, a space or a carriage return.
+ */
+static inline bool isSeparator(char c) {
+    return c == '\t' || c == ' ' || c == '\r';
+}
+
+/**
+ * @brief Finds the next field of a line, skipping the separators in front of it.
+ * @param pos The position to start from, moved past the end of the field.
+ * @param end The end of the line.
+ * @param fieldBegin Set to the start of the field.
+ * @param fieldEnd Set to the end of the field.
+ * @return True if a field was found before the end of the line.
+ */
+static inline bool nextField(const char*& pos, const char* end, const char*& fieldBegin, const char*& fieldEnd) {
+    while (pos < end && isSeparator(*pos)) {
+        pos++;
+    }
+    fieldBegin = pos;
+    while (pos < end && !isSeparator(*pos)) {
+        pos++;
+    }
+    fieldEnd = pos;
+    return fieldBegin != fieldEnd;
+}
+
+/**
+ * @brief Parses a number field, which must be made up entirely of the number.
+ * @param pos The position to start from, moved past the end of the field.
+ * @param end The end of the line.
+ * @param value Set to the value parsed.
+ * @return True if the field holds a valid number.
+ */
+template <typename T>
+static inline bool parseField(const char*& pos, const char* end, T& value) {
+    const char* fieldBegin;
+    const char* fieldEnd;
+    if (!nextField(pos, end, fieldBegin, fieldEnd)) {
+        return false;
+    }
+    from_chars_result result = from_chars(fieldBegin, fieldEnd, value);
+    return result.ec == errc() && result.ptr == fieldEnd;
+}
+
 /**
- * @brief Retrieves database records from a file and returns them as a vector of GameData objects.
+ * @brief Parses the digits at the start of a date component.
+ * @param pos The position to start from, moved past the digits.
+ * @param end The end of the date.
+ * @return The value of the digits, or 0 if there are none.
+ */
+static inline int parseDateComponent(const char*& pos, const char* end) {
+    int value = 0;
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        value = value*10 + (*pos - '0');
+        pos++;
+    }
+    return value;
+}
+
+// Counts the days from 1970-01-01 to a date of the proleptic Gregorian calendar
+/**
+ * @brief Converts a calendar date into a number of days since the Unix epoch.
  *
- * This method reads a file containing database records, parses each line, and constructs
- * GameData objects representing the records. It returns these objects as a vector.
+ * The year is shifted to start in March, so the leap day falls at the end of the year, and split into
+ * 400-year eras of 146097 days each. This needs no time zone data and gives the same result on every host.
  *
- * @return A vector of GameData objects representing database records.
+ * @param year The year.
+ * @param month The month, from 1 to 12.
+ * @param day The day of the month, from 1 to 31.
+ * @return The number of days since 1970-01-01, negative for earlier dates.
  */
-std::vector<GameData> databaseStorage::getDatabaseRecord(){
-    string pathtofile = std::filesystem::current_path().parent_path().string() + "/games.txt";
-    std::ifstream inputFile(pathtofile);
-    if (!inputFile.is_open()) {
-        std::cerr << "Error opening file." << std::endl;
-    }
+static inline long long daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    unsigned int yearOfEra = (unsigned int)(year - era*400); // [0, 399]
+    unsigned int dayOfYear = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1; // [0, 365]
+    unsigned int dayOfEra = yearOfEra*365 + yearOfEra/4 - yearOfEra/100 + dayOfYear; // [0, 146096]
+    return era*146097 + (long long)dayOfEra - 719468;
+}
 
-    std::vector<GameData> gameDataList;
+// Converts a dd/mm/yyyy date into a timestamp at midnight (UTC)
+/**
+ * @brief Parses a date written as dd/mm/yyyy.
+ *
+ * Consecutive lines of the input file mostly share the same date, so the last date converted by each
+ * thread is remembered and reused.
+ *
+ * @param begin The start of the date.
+ * @param end The end of the date.
+ * @return The timestamp of midnight UTC on that date.
+ */
+static time_t parseDate(const char* begin, const char* end) {
+    thread_local int lastDate = -1;
+    thread_local time_t lastTimestamp = 0;
 
-    std::string line;
+    const char* pos = begin;
+    int day = parseDateComponent(pos, end);
+    pos += (pos < end); // Skip the '/'
+    int month = parseDateComponent(pos, end);
+    pos += (pos < end);
+    int year = parseDateComponent(pos, end);
 
-    int count = 1;
+    int date = (year*16 + month)*32 + day;
+    if (date != lastDate) {
+        lastDate = date;
+        lastTimestamp = (time_t)(daysFromCivil(year, month, day)*86400);
+    }
+    return lastTimestamp;
+}
 
-    // Skip the first line (column titles)
-    std::getline(inputFile, line);
+// Parses a line into a record, rejecting lines with missing (null) values
+/**
+ * @brief Parses a line of the input file into a GameData record.
+ * @param begin The start of the line.
+ * @param end The end of the line, excluding the newline.
+ * @param gameData The record to fill in.
+ * @return True if every field of the line was parsed.
+ */
+static bool parseLine(const char* begin, const char* end, GameData& gameData) {
+    const char* pos = begin;
+    const char* dateBegin;
+    const char* dateEnd;
+    if (!nextField(pos, end, dateBegin, dateEnd)) {
+        return false;
+    }
 
+    // Fields are parsed into locals, as the members of the packed GameData may not be aligned
+    unsigned int teamId;
+    unsigned short pts, ast, reb, homeTeamWins;
+    float fgPct, ftPct, fg3Pct;
+    if (!(parseField(pos, end, teamId) && parseField(pos, end, pts) &&
+          parseField(pos, end, fgPct) && parseField(pos, end, ftPct) &&
+          parseField(pos, end, fg3Pct) && parseField(pos, end, ast) &&
+          parseField(pos, end, reb) && parseField(pos, end, homeTeamWins))) {
+        return false;
+    }
+    gameData.GAME_DATE_EST = parseDate(dateBegin, dateEnd);
+    gameData.TEAM_ID_home = teamId;
+    gameData.PTS_home = pts;
+    gameData.FG_PCT_home = fgPct;
+    gameData.FT_PCT_home = ftPct;
+    gameData.FG3_PCT_home = fg3Pct;
+    gameData.AST_home = ast;
+    gameData.REB_home = reb;
+    gameData.HOME_TEAM_WINS = homeTeamWins;
+    return true;
+}
 
-    while (std::getline(inputFile, line)) {
-        std::istringstream iss(line);
+/**
+ * @brief Parses every line of a chunk of the input file.
+ * @param begin The start of the chunk, at the start of a line.
+ * @param end The end of the chunk, just after a newline or at the end of the file.
+ * @param gameDataList The vector to append the records of the chunk to.
+ */
+static void parseChunk(const char* begin, const char* end, vector<GameData>* gameDataList) {
+    const char* lineBegin = begin;
+    while (lineBegin < end) {
+        const char* lineEnd = (const char*)memchr(lineBegin, '\n', end - lineBegin);
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
         GameData gameData;
-        count++;
-
-        string dateString;
-        iss >> dateString;
-
-        std::tm tm = {}; // Initialize a std::tm structure with zeros
-        std::istringstream dateStream(dateString);
-        dateStream >> tm.tm_mday;   // Day of the month
-        dateStream.ignore(1);       // Ignore the '/'
-        dateStream >> tm.tm_mon;    // Month (0-based, so subtract 1)
-        dateStream.ignore(1);       // Ignore the '/'
-        dateStream >> tm.tm_year;   // Year (since 1900)
-
-        // Adjust month to be 0-based (January is 0)
-        tm.tm_mon--;
-
-        // Adjust year to be years since 1900
-        tm.tm_year -= 1900;
-
-        // Fill in other fields with reasonable defaults (e.g., time is set to midnight)
-        tm.tm_hour = 0;
-        tm.tm_min = 0;
-        tm.tm_sec = 0;
-
-        // Use std::mktime to convert std::tm to a time representation (time_t)
-        time_t timestamp = std::mktime(&tm);
-        gameData.GAME_DATE_EST = timestamp;
-
-        if (!(iss >> gameData.TEAM_ID_home >> gameData.PTS_home >>
-                  gameData.FG_PCT_home >> gameData.FT_PCT_home >> gameData.FG3_PCT_home >>
-                  gameData.AST_home >> gameData.REB_home >> gameData.HOME_TEAM_WINS)) {
-            continue;
+        if (parseLine(lineBegin, lineEnd, gameData)) {
+            gameDataList->push_back(gameData);
         }
-        // Handle missing values (nulls) by setting them to 0
-        if (iss.fail()) {
-            gameData.FG_PCT_home = 0.0;
-            gameData.FT_PCT_home = 0.0;
-            gameData.FG3_PCT_home = 0.0;
-            gameData.AST_home = 0;
-            gameData.REB_home = 0;
-            gameData.HOME_TEAM_WINS = 0;
+        lineBegin = lineEnd + 1;
+    }
+}
+
+/**
+ * @brief Opens the input file and maps it into memory, or reads it in whole where mmap is not available.
+ * @param inputFile The input file to fill in.
+ * @return True if the file was opened, even if it is empty.
+ */
+static bool openInputFile(InputFile& inputFile) {
+    string pathtofile = std::filesystem::current_path().parent_path().string() + "/games.txt";
+    inputFile.data = nullptr;
+    inputFile.size = 0;
+    inputFile.mapping = nullptr;
+#ifndef _WIN32
+    int fileDescriptor = open(pathtofile.c_str(), O_RDONLY);
+    struct stat fileStatus;
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &fileStatus) != 0) {
+        std::cerr << "Error opening file." << std::endl;
+        if (fileDescriptor >= 0) {
+            close(fileDescriptor);
         }
+        return false;
+    }
+    inputFile.size = fileStatus.st_size;
+    if (inputFile.size == 0) {
+        close(fileDescriptor);
+        return true;
+    }
+    void* mapping = mmap(nullptr, inputFile.size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error opening file." << std::endl;
+        inputFile.size = 0;
+        return false;
+    }
+    madvise(mapping, inputFile.size, MADV_SEQUENTIAL);
+    inputFile.mapping = mapping;
+    inputFile.data = (const char*)mapping;
+#else
+    std::ifstream input(pathtofile, std::ios::binary);
+    if (!input.is_open()) {
+        std::cerr << "Error opening file." << std::endl;
+        return false;
+    }
+    inputFile.contents.assign((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    inputFile.data = inputFile.contents.data();
+    inputFile.size = inputFile.contents.size();
+#endif
+    return true;
+}
+
+/**
+ * @brief Unmaps the input file.
+ * @param inputFile The input file opened with openInputFile().
+ */
+static void closeInputFile(InputFile& inputFile) {
+#ifndef _WIN32
+    if (inputFile.mapping != nullptr) {
+        munmap(inputFile.mapping, inputFile.size);
+    }
+#else
+    std::string().swap(inputFile.contents);
+#endif
+    inputFile.mapping = nullptr;
+    inputFile.data = nullptr;
+    inputFile.size = 0;
+}
+
+/**
+ * @brief Finds the start of the records of the input file.
+ * @param inputFile The input file.
+ * @return The start of the line after the first line (column titles).
+ */
+static const char* skipTitleLine(const InputFile& inputFile) {
+    const char* end = inputFile.data + inputFile.size;
+    const char* firstLineEnd = (const char*)memchr(inputFile.data, '\n', inputFile.size);
+    return (firstLineEnd == nullptr) ? end : firstLineEnd + 1;
+}
+
+/**
+ * @brief Opens the input file and starts parsing it on a producer thread.
+ * @param batchSize The maximum number of records in a batch.
+ * @param maxQueuedBatches The maximum number of parsed batches waiting to be pulled.
+ */
+RecordStream::RecordStream(size_t batchSize, size_t maxQueuedBatches)
+{
+    this->batchSize = max<size_t>(1, batchSize);
+    this->maxQueuedBatches = max<size_t>(1, maxQueuedBatches);
+    isFinished = false;
+    isStopped = false;
+    isOpen = openInputFile(inputFile);
+    if (!isOpen) {
+        isFinished = true;
+        return;
+    }
+    producer = thread(&RecordStream::produce, this);
+}
+
+/**
+ * @brief Stops the producer thread if it is still parsing, and unmaps the input file.
+ */
+RecordStream::~RecordStream()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        isStopped = true;
+    }
+    notFull.notify_all();
+    if (producer.joinable()) {
+        producer.join();
+    }
+    closeInputFile(inputFile);
+}
 
-        // Store the parsed data in the vector
-        gameDataList.push_back(gameData);
-        //cout << count << endl;
+/**
+ * @brief Pulls the next batch of records, waiting for the producer thread if no batch is ready.
+ * @param batch Replaced by the next batch of records, in file order.
+ * @return True if a batch was pulled, false once every record has been pulled.
+ */
+bool RecordStream::nextBatch(vector<GameData>& batch)
+{
+    unique_lock<mutex> lock(queueMutex);
+    notEmpty.wait(lock, [this] { return !batches.empty() || isFinished; });
+    if (batches.empty()) {
+        batch.clear();
+        return false;
     }
+    batch.swap(batches.front());
+    batches.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
 
-    return gameDataList;
+/**
+ * @brief Hands a full batch over to the consumer, waiting while maxQueuedBatches batches are waiting to be pulled.
+ * @param batch The batch to queue, replaced by an empty batch.
+ * @return False if the stream was stopped before the batch could be queued.
+ */
+bool RecordStream::queueBatch(vector<GameData>& batch)
+{
+    unique_lock<mutex> lock(queueMutex);
+    notFull.wait(lock, [this] { return batches.size() < maxQueuedBatches || isStopped; });
+    if (isStopped) {
+        return false;
+    }
+    batches.push_back(std::move(batch));
+    lock.unlock();
+    notEmpty.notify_one();
+    batch = vector<GameData>();
+    batch.reserve(batchSize);
+    return true;
 }
 
+// Parses the input file a round of chunks at a time, one chunk per parser, and hands over their records in file order
+/**
+ * @brief Parses the input file into batches of records on the producer thread.
+ *
+ * Each round splits the next part of the input file into chunks ending on a newline, which are parsed in parallel
+ * on a pool of parsers. The records of the chunks are then queued in file order, in batches of batchSize records.
+ * The producer waits while maxQueuedBatches batches are waiting to be pulled, so the memory used by parsed records
+ * stays bounded regardless of the size of the input file.
+ */
+void RecordStream::produce()
+{
+    const char* begin = (inputFile.size == 0) ? nullptr : skipTitleLine(inputFile);
+    const char* end = inputFile.data + inputFile.size;
+    size_t numParsers = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), (end - begin) / MIN_CHUNK_SIZE));
+    ThreadPool parsers(numParsers);
+    vector<vector<GameData>> chunkLists(numParsers);
+    vector<GameData> batch;
+    batch.reserve(batchSize);
+    bool isStopping = false;
+
+    while (begin < end && !isStopping) {
+        // Split the next round into one chunk per parser, moving each boundary forward to the start of the next line
+        vector<const char*> boundaries = {begin};
+        for (size_t i = 0; i < numParsers && boundaries.back() < end; i++) {
+            const char* boundary = boundaries.back() + min<size_t>(MIN_CHUNK_SIZE, end - boundaries.back());
+            const char* lineEnd = (boundary == end) ? nullptr : (const char*)memchr(boundary, '\n', end - boundary);
+            boundaries.push_back(lineEnd == nullptr ? end : lineEnd + 1);
+        }
+        size_t numChunks = boundaries.size() - 1;
+        parsers.run(numChunks, [&](size_t chunk, unsigned int) {
+            chunkLists[chunk].clear();
+            parseChunk(boundaries[chunk], boundaries[chunk + 1], &chunkLists[chunk]);
+        });
+        begin = boundaries.back();
+
+        // Queue the records of the round in file order, handing over a batch whenever it is full
+        for (size_t chunk = 0; chunk < numChunks && !isStopping; chunk++) {
+            for (size_t i = 0; i < chunkLists[chunk].size() && !isStopping; i++) {
+                batch.push_back(chunkLists[chunk][i]);
+                if (batch.size() == batchSize) {
+                    isStopping = !queueBatch(batch);
+                }
+            }
+        }
+    }
+    if (!isStopping && !batch.empty()) {
+        queueBatch(batch);
+    }
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        isFinished = true;
+    }
+    notEmpty.notify_all();
+}
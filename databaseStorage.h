@@ -5,25 +5,81 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "ProjectStructure.h"
 
 using namespace std;
 /**
- * @brief databaseStorage class represents a storage mechanism for database records.
- *
- * This class provides a method to retrieve database records as a vector of GameData objects.
+ * @brief Struct to hold the content of the input file, mapped into memory.
+ */
+struct InputFile {
+    const char* data; ///< The content of the file.
+    size_t size; ///< The size of the file in bytes.
+    void* mapping; ///< The memory mapping of the file, or nullptr if it is not mapped.
+    string contents; ///< The content of the file, where it cannot be mapped.
+};
+
+/**
+ * @brief RecordStream reads database records from the input file in batches, without loading the whole file.
  *
+ * A producer thread parses the input file while the records already parsed are being pulled, and stops
+ * when a bounded number of batches are waiting. The producer splits the file into chunks ending on a newline
+ * and parses several chunks at a time in parallel, one per core, before queuing their records in file order. The memory used by the parsed records therefore does not
+ * grow with the size of the input file, and parsing overlaps with the work done on each batch.
  */
-class databaseStorage{
+class RecordStream {
     public:
+        bool isOpen; ///< Whether the input file was opened.
+
+        /**
+         * @brief Opens the input file and starts parsing it.
+         * @param batchSize The maximum number of records in a batch.
+         * @param maxQueuedBatches The maximum number of parsed batches waiting to be pulled.
+         */
+        RecordStream(size_t batchSize = 4096, size_t maxQueuedBatches = 4);
+
+        /**
+         * @brief Destroys the RecordStream object, stopping the parsing if not every batch has been pulled.
+         */
+        ~RecordStream();
+
+        RecordStream(const RecordStream&) = delete;
+        RecordStream& operator=(const RecordStream&) = delete;
+
+        /**
+         * @brief Pulls the next batch of records, in the order of the input file.
+         * @param batch Replaced by the next batch of records.
+         * @return True if a batch was pulled, false if every record has already been pulled.
+         */
+        bool nextBatch(vector<GameData>& batch);
+
+    private:
+        size_t batchSize;
+        size_t maxQueuedBatches;
+        InputFile inputFile;
+        deque<vector<GameData>> batches; // parsed batches waiting to be pulled, oldest first
+        bool isFinished; // set once the producer has queued its last batch
+        bool isStopped; // set when the stream is destroyed before every batch is pulled
+        mutex queueMutex;
+        condition_variable notEmpty;
+        condition_variable notFull;
+        thread producer;
+
+        /**
+         * @brief Parses the input file into batches of records, run on the producer thread.
+         */
+        void produce();
+
         /**
-         * @brief Retrieves database records.
-         *
-         * This function retrieves database records and returns them as a vector of GameData objects.
-         *
-         * @return A vector of GameData objects representing database records.
+         * @brief Hands a batch over to the consumer, waiting while maxQueuedBatches batches are waiting to be pulled.
+         * @param batch The batch to queue, replaced by an empty batch.
+         * @return False if the stream was stopped before the batch could be queued.
          */
-        vector<GameData> getDatabaseRecord();
+        bool queueBatch(vector<GameData>& batch);
 };
 
 #endif //PROJECT1_DATABASESTORAGE_H
@@ -1,24 +1,100 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cerrno>
+#include <climits>
 #include <filesystem>
+#include <chrono>
 #include "Database.h"
 #include "ProjectStructure.h"
 
 using namespace std;
+
+// Writes the keys of every index node visited by the next lookups of the B+ tree to the output of an experiment
+/**
+ * @brief Traces the index nodes accessed by the lookups of a B+ tree to an output file.
+ * @param tree The B+ tree to trace.
+ * @param output The output file stream to write the visited nodes to, or a closed stream to stop tracing.
+ */
+void traceIndexNodes(BPlusTree* tree, ofstream &output) {
+    if (!output.is_open()) {
+        tree->nodeVisitObserver = nullptr;
+        return;
+    }
+    tree->nodeVisitObserver = [tree, &output](void* node, unsigned int level) {
+        unsigned int numKeys = *(unsigned int*)node;
+        float* keys = tree->getKeys(node);
+        char toPrint[24];
+        output << "Index node at level " << level << ": | ";
+        for (unsigned int i = 0; i < tree->maxKeys; i++) {
+            if (i < numKeys) {
+                snprintf(toPrint, 24, "%7f | ", keys[i]);
+            } else {
+                snprintf(toPrint, 24, "%6s | ", "   ");
+            }
+            output << toPrint;
+        }
+        output << "\n";
+    };
+}
+
 /**
  * @brief Main function to manage the Database System Principles Project-1.
+ * @param argc Number of command line arguments.
+ * @param argv Command line arguments. An optional path to a database file stores the database in that file ("-" keeps it in memory),
+ * optionally followed by "pax" to store the records in the PAX block layout and "aggregate" to hold the COUNT and SUM of
+ * FG3_PCT_home in the B+ tree nodes. "snapshot=<path>" loads the database from a snapshot file instead of importing the data,
+ * or saves the imported database to that file if it does not exist yet. "aligned" stores the B+ tree nodes in the cache-line-aligned
+ * node layout, and "blocksize=<bytes>" changes the size of the blocks (and so of the nodes) from 400B, e.g. to a multiple of the cache line size.
+ * The block size must be at least MIN_BLOCK_SIZE, and large enough for a node of the chosen layout.
  * @return Exit code (0 for successful execution).
  */
-int main() {
+int main(int argc, char* argv[]) {
 
     Database* db;
-    const unsigned int blockSize = 400;
+    unsigned int blockSize = 400;
     // Using disk capacity of 100MB
     unsigned int diskSize = 100;
     string resultsDir = filesystem::current_path().parent_path().string() + "//outputs//";
-    db = new Database(diskSize, blockSize);
 
+    // Store the database in the given file, which is reopened without importing the data if it already exists
+    BlockLayout layout = NSM;
+    int aggregateColumn = -1;
+    NodeLayout nodeLayout = PACKED_NODES;
+    string snapshotPath;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "pax") == 0) {
+            layout = PAX;
+        } else if (strcmp(argv[i], "aggregate") == 0) {
+            aggregateColumn = FG3_PCT_HOME_COLUMN;
+        } else if (strncmp(argv[i], "snapshot=", 9) == 0) {
+            snapshotPath = argv[i] + 9;
+        } else if (strcmp(argv[i], "aligned") == 0) {
+            nodeLayout = ALIGNED_NODES;
+        } else if (strncmp(argv[i], "blocksize=", 10) == 0) {
+            char* end;
+            errno = 0;
+            unsigned long size = strtoul(argv[i] + 10, &end, 10);
+            if (argv[i][10] == '\0' || argv[i][10] == '-' || *end != '\0' || errno == ERANGE || size < MIN_BLOCK_SIZE || size > UINT_MAX) {
+                cout << "Invalid block size " << argv[i] + 10 << ": usage is blocksize=<bytes>, with at least "
+                     << MIN_BLOCK_SIZE << " bytes." << endl;
+                return 1;
+            }
+            blockSize = size;
+        }
+    }
+    try {
+        if (argc > 1 && strcmp(argv[1], "-") != 0) {
+            db = new Database(argv[1], diskSize, blockSize, 1024, CLOCK, layout, aggregateColumn, nodeLayout);
+        } else {
+            db = new Database(diskSize, blockSize, 1024, CLOCK, layout, aggregateColumn, nodeLayout);
+        }
+    } catch (const exception& e) {
+        cout << e.what() << endl;
+        return 1;
+    }
+
+    ofstream noTrace;
     ofstream exp1Output;
     ifstream exp1Input;
     ofstream exp2Output;
@@ -36,16 +112,31 @@ int main() {
 
     int choice;
 
-    db->importData();
-
-    /*vector<duplicateCounter> potato = db->bPlusTree->duplicateCount;
-    for (auto& entry : potato) {
-        if (entry.keyValue == 0.5) {
-            // Value found, increment the count
-            cout << "duplicate count is: " << entry.count << endl;
-            break;
+    if (db->disk->isReopened) {
+        cout << "Database has been successfully reopened from " << argv[1] << endl;
+    } else if (!snapshotPath.empty() && filesystem::exists(snapshotPath)) {
+        try {
+            auto start = chrono::high_resolution_clock::now();
+            db->loadSnapshot(snapshotPath);
+            auto stop = chrono::high_resolution_clock::now();
+            cout << "Database has been successfully loaded from " << snapshotPath << " in "
+                 << chrono::duration_cast<chrono::microseconds>(stop - start).count() << " microseconds" << endl;
+        } catch (const exception& e) {
+            cout << e.what() << endl;
+            delete db;
+            return 1;
         }
-    }*/
+    } else {
+        db->importData();
+        if (!snapshotPath.empty()) {
+            try {
+                db->saveSnapshot(snapshotPath);
+                cout << "Database has been saved to " << snapshotPath << endl;
+            } catch (const exception& e) {
+                cout << e.what() << endl;
+            }
+        }
+    }
 
     while(1){
         cout << "=====================================\n"
@@ -80,7 +171,7 @@ int main() {
                 exp1Output << "===============================================" << endl;
                 exp1Output << "Number of records: " << db->numRecords << endl;
                 exp1Output << "Size of a record: " << (sizeof(GameData)) << "-Byte" << endl;
-                exp1Output << "Number of records stored in a block: " << ceil((blockSize - sizeof(unsigned int))/ (sizeof(GameData) + sizeof(indexMapping))) << endl;
+                exp1Output << "Number of records stored in a block: " << db->MAX_RECORDS << endl;
                 exp1Output << "Number of blocks for storing the data: " << db->numBlocks << endl;
                 //exp1Output << "===============================================" << endl;
                 exp1Output.close();
@@ -102,6 +193,7 @@ int main() {
                 exp2Output << "===============================================================" << endl;
                 exp2Output << "Parameter n of the B+ Tree: " << db->bPlusTree->maxKeys << "\n";
                 exp2Output << "Number of nodes: " << db->bPlusTree->numNodes << "\n";
+                exp2Output << "Number of overflow nodes: " << db->bPlusTree->numOverflowNodes << "\n";
                 exp2Output << "Number of levels of the B+ tree: " << db->bPlusTree->height+1 << "\n"; // DBMS starts height at 0
                 //exp2Output << "Root: \n";
                 //treeStructure = db->bPlusTree->printTree(exp2Output);
@@ -130,14 +222,22 @@ int main() {
             case 3:
                 cout << "===============================================================" << endl;
                 cout << "Experiment 3: ";
-                // already writing in the file in BPlusTree.cpp in findNode and find record
+                // the index nodes visited are traced by traceIndexNodes(), the results are written by findRecord and the Database functions
                 exp3Output.open(resultsDir + "experiment3output.txt");
                 exp3Output << "Retrieve movies with 'FG_PCT_HOME' equal to 0.5  \n";
                 exp3Output << "===============================================================" << endl;
                 //db->bPlusTree->findRecord(0.5, 0.5001, exp3Output);
                 //exp3Output << db->bPlusTree->averageValue(0.5, 0.5001, exp3Output);
-                db->bPlusTree->linearScan(0.5, 0.5001, exp3Output);
-                db->bPlusTree->avgFG3(0.5, 0.5001, exp3Output);
+                traceIndexNodes(db->bPlusTree, exp3Output);
+                db->bPlusTree->findRecord(0.5, 0.5, exp3Output);
+                traceIndexNodes(db->bPlusTree, noTrace);
+                db->linearScan(0.5, 0.5, exp3Output);
+                db->retrieveRecords(0.5, 0.5, exp3Output);
+                db->executeRangeQuery(0.5, 0.5, exp3Output);
+                db->aggregate(0.5, 0.5, FG3_PCT_HOME_COLUMN, exp3Output);
+                if (db->aggregateColumn != -1) {
+                    db->aggregateFromIndex(0.5, 0.5, exp3Output);
+                }
                 //exp3Output << "===============================================================" << endl;
                 exp3Output.close();
                 exp3Input.open(resultsDir + "experiment3output.txt");
@@ -153,12 +253,21 @@ int main() {
             case 4:
                 cout << "======================================================================" << endl;
                 cout << "Experiment 4: ";
-                // already writing in the file in BPlusTree.cpp in findNode and find record
+                // the index nodes visited are traced by traceIndexNodes(), the results are written by findRecord and the Database functions
                 exp4Output.open(resultsDir + "experiment4output.txt");
                 exp4Output << "Retrieve movies with 'FG_PCT_HOME' between 0.6 and 1.0 \n";
                 exp4Output << "======================================================================" << endl;
-                db->bPlusTree->linearScan(0.6, 1.0, exp4Output);
-                db->bPlusTree->avgFG3(0.6, 1.0, exp4Output);
+                traceIndexNodes(db->bPlusTree, exp4Output);
+                db->bPlusTree->findRecord(0.6, 1.0, exp4Output);
+                traceIndexNodes(db->bPlusTree, noTrace);
+                db->linearScan(0.6, 1.0, exp4Output);
+                db->retrieveRecords(0.6, 1.0, exp4Output);
+                db->executeRangeQuery(0.6, 1.0, exp4Output);
+                db->aggregate(0.6, 1.0, FG3_PCT_HOME_COLUMN, exp4Output);
+                db->aggregateParallel(0.6, 1.0, FG3_PCT_HOME_COLUMN, exp4Output);
+                if (db->aggregateColumn != -1) {
+                    db->aggregateFromIndex(0.6, 1.0, exp4Output);
+                }
                 exp4Output.close();
                 // reading from the txt file for experiment-4
                 exp4Input.open(resultsDir + "experiment4output.txt");
@@ -176,9 +285,9 @@ int main() {
                 cout << "Experiment 5:";
                 cout << "Delete movies with the attribute “FG_PCT_home” below 0.35 inclusively\n";
                 cout << "=======================================================================================" <<endl;
-                //exp5Output.open(resultsDir + "experiment5output.txt");
-                //db->bPlusTree->deleteBelowThreshold(0.35, exp5Output);
-                //exp5Output.close();
+                exp5Output.open(resultsDir + "experiment5output.txt");
+                db->deleteRecords(0.0f, 0.35, exp5Output);
+                exp5Output.close();
                 exp5Input.open(resultsDir + "experiment5output.txt");
                 if(exp5Input.is_open()){
                     while (getline(exp5Input, line)) {
@@ -187,13 +296,13 @@ int main() {
                 } else {
                     cout << "Unable to read the file" << endl;
                 }
-                db->bPlusTree->deleteBelowThreshold(0.35, exp5Output);
                 exp5Input.close();
                 break;
             case 6:
                 cout << "=============================" << "\n";
                 cout << "  Terminating the project" << endl;
                 cout << "=============================" << "\n";
+                delete db;
                 exit(0);
             default:
                 cout << "Invalid input. Please input a value from 1 to 6." << endl;